@@ -0,0 +1,421 @@
+﻿#include <opencv2/opencv.hpp>
+#include <opencv/cv.h>
+
+#include "BackGroundRemover.h"
+#include "Histogrammer.h"
+#include "ContourAnalyzer.h"
+#include "AppearanceAnalyzer.h"
+#include "TemplateGenerator.h"
+#include "Tracker.h"
+#include "OcclusionSolver.h"
+#include "MultiCameraTracker.h"
+#include "Chromaticity.h"
+#include "PeakFinder.h"
+#include "SmallTemplateMatcher.h"
+#include "globalSettings.h"
+
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+
+using namespace cv;
+using namespace std;
+using namespace st;
+
+//*************************************************************************************************
+// ----- Micro-benchmarks of the hot functions of the tracker. Every case runs on fixed inputs
+// ----- (generated from a constant seed) and reports time per call, processed bytes and the
+// ----- number of heap and Mat allocations per call. Run it from the "Soccer Tracker" folder,
+// ----- the appearance classifier is read from there. Arguments select cases by a part of their name
+//*************************************************************************************************
+
+
+//=================================================================================================
+// ----- every operator new and every Mat buffer is counted -----
+static atomic<long long> newCount(0), matCount(0), matBytes(0);
+
+void* operator new (size_t size) {
+	newCount++;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) throw bad_alloc();
+	return p;
+}
+void* operator new[] (size_t size) { return operator new(size); }
+void operator delete (void* p) noexcept { free(p); }
+void operator delete[] (void* p) noexcept { free(p); }
+
+//*************************************************************************************************
+// ----- Counts the buffers of Mats, the allocation itself is left to the default allocator
+//*************************************************************************************************
+class CountingMatAllocator : public MatAllocator {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		MatAllocator* base;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		CountingMatAllocator (MatAllocator* base) : base(base) {}
+
+		//=========================================================================================
+		UMatData* allocate (int dims, const int* sizes, int type, void* data, size_t* step, int flags, UMatUsageFlags usageFlags) const {
+			UMatData* u = base->allocate(dims, sizes, type, data, step, flags, usageFlags);
+			if (u != NULL && data == NULL) {
+				matCount++;
+				matBytes += (long long)u->size;
+			}
+			return u;
+		}
+
+		//=========================================================================================
+		bool allocate (UMatData* data, int accessFlags, UMatUsageFlags usageFlags) const {
+			return base->allocate(data, accessFlags, usageFlags);
+		}
+
+		//=========================================================================================
+		void deallocate (UMatData* data) const {
+			base->deallocate(data);
+		}
+};
+
+//*************************************************************************************************
+struct BenchCase {
+	string name;
+	size_t bytesPerOp;		// bytes read by one call, 0 = not a data-parallel kernel
+	int warmUp;				// calls before measuring (kernels with history need to reach steady state)
+	function<void()> body;
+};
+
+volatile double sink = 0.0; // results are written here, so calls can not be optimized away
+
+//=================================================================================================
+void runCase (BenchCase& bc) {
+
+	typedef chrono::steady_clock Clock;
+
+	for (int i = 0; i < bc.warmUp; i++) bc.body();
+
+	// ---------- batch size: about 50 ms per batch ----------
+	long long batch = 1;
+	while (true)
+	{
+		Clock::time_point tic = Clock::now();
+		for (long long i = 0; i < batch; i++) bc.body();
+		double elapsed = chrono::duration<double>(Clock::now() - tic).count();
+		if (elapsed > 0.05 || batch > (1LL << 30)) break;
+		batch *= 2;
+	}
+
+	// ---------- the fastest of 5 batches, allocations of all of them ----------
+	const int batches = 5;
+	double best = 1e300;
+	long long news = newCount, mats = matCount, matB = matBytes;
+	for (int b = 0; b < batches; b++)
+	{
+		Clock::time_point tic = Clock::now();
+		for (long long i = 0; i < batch; i++) bc.body();
+		double ns = chrono::duration<double, nano>(Clock::now() - tic).count() / batch;
+		best = std::min(best, ns);
+	}
+	double calls = double(batch) * batches;
+
+	char bandwidth[32] = "-";
+	if (bc.bytesPerOp > 0) sprintf(bandwidth, "%.1f", bc.bytesPerOp / best * 1e9 / (1 << 20));
+
+	printf("%-40s %10lld %12.1f %10s %8.2f %8.2f %10.1f\n", bc.name.c_str(), (long long)calls, best, bandwidth,
+		(newCount - news) / calls, (matCount - mats) / calls, (matBytes - matB) / calls / 1024.0);
+	fflush(stdout);
+}
+
+//=================================================================================================
+Mat makeFrame () {
+	// ---------- pitch-like frame: noisy green, players of two teams, one ball ----------
+	RNG rng(12345);
+	Mat frame(fSize.y, fSize.x, CV_8UC3);
+	rng.fill(frame, RNG::NORMAL, Scalar(63, 98, 84), Scalar(6, 6, 6));
+
+	for (int i = 0; i < 22; i++)
+	{
+		Point foot(rng.uniform(20, fSize.x - 20), rng.uniform(80, fSize.y - 5));
+		int h = 25 + foot.y / 12;
+		Scalar shirt = (i % 2 == 0) ? Scalar(40, 40, 200) : Scalar(210, 170, 60);
+		ellipse(frame, foot - Point(0, h / 2), Size(h / 6, h / 2), 0, 0, 360, shirt, -1);
+	}
+	circle(frame, Point(480, 300), 4, Scalar(240, 240, 240), -1);
+	return frame;
+}
+
+//=================================================================================================
+int main (int argc, char** argv) {
+
+	static CountingMatAllocator matAllocator(Mat::getDefaultAllocator());
+	Mat::setDefaultAllocator(&matAllocator);
+
+	fSize = Point(960, 540);
+	ID_counter = 0;
+	ID_groups_cnt = 10;
+	ID_shift = 0;
+
+	// ---------- fixed inputs ----------
+	Mat frame = makeFrame();
+	size_t frameBytes = frame.total() * frame.elemSize();
+
+	BackGroundRemover remover(500, 256, 5, false);
+	Mat normalized = Mat::zeros(frame.size(), CV_8UC3), mask;
+	remover.normalizeImage(frame, normalized);
+	remover.smoothImage(normalized, 5);
+	remover.HistMethod(normalized, mask, false);
+
+	int channels[1] = { 1 }, bins[1] = { 256 };
+	float range[2] = { 0.0f, 255.0f };
+	const float* ranges[1] = { range };
+	MatND hist;
+	calcHist(&normalized, 1, channels, Mat(), hist, 1, bins, ranges);
+	MatND smoothedHist = Histogrammer::filterHist(hist);
+	MatND histMask = Histogrammer::getHistMask(smoothedHist);
+	MatND maskedHist;
+	multiply(hist, histMask, maskedHist);
+
+	AppearanceAnalyzer appearance;
+	MATCH_BACKEND defaultBackend = appearance.getMatchBackend();
+	vector<Mat> ballTempls = TemplateGenerator::createBallTemplVctr(3, 6, 1, Scalar(63, 98, 84));
+	appearance.setBallTempls(ballTempls);
+	appearance.setTeamModel(ModelRegistry::instance().getTeamModel());
+	appearance.setFrame(frame);
+	Mat restrictedArea(fSize, CV_32FC1, 1.0);
+	appearance.setRestrictedArea(restrictedArea);
+	BallCandidate ballCand(0, Point(480, 300), Point(45, 35), 0.0);
+	Rect playerRect(300, 200, 24, 60);
+
+	Tracker tracker;
+	vector<BallCandidate*> windows;
+	{
+		RNG rng(777);
+		for (int i = 0; i < 30; i++) {
+			windows.push_back(new BallCandidate(0, Point(rng.uniform(100, 860), rng.uniform(100, 440)), Point(45, 35), 0.5));
+		}
+	}
+
+	MultiCameraTracker mcTracker;
+	Point3d camTop(87.56, 67.928 + 34.52, 60.69), camBtm(87.69, 67.928 - 103.14, 60.62);
+	Point3d ballTop(60.0, 30.0, 0.0), ballBtm(61.0, 38.0, 0.0);
+
+	Mat homography = (Mat_<double>(3, 3) <<
+		5.3608415917828123e-001, 1.9293910165113934e+000, 1.1233775219342288e+003,
+		9.5535039115444819e-003, 2.6175494987253267e+000, -2.7989463296233839e+002,
+		1.5862308199046533e-005, 1.2003129125721726e-003, 1.);
+	ProjCandidate projCand(0, 0, camTop, homography);
+	TrackInfo trackInfo;
+	trackInfo.set(1, Rect(470, 290, 20, 20), Point(480, 300), Point(482, 301), Point(478, 299));
+	int projFrame = 0;
+
+	// ---------- cases ----------
+	vector<BenchCase> cases;
+
+	Mat normOut = Mat::zeros(frame.size(), CV_8UC3);
+	cases.push_back({ "BackGroundRemover::normalizeImage", frameBytes, 3, [&] {
+		remover.normalizeImage(frame, normOut);
+		sink += normOut.data[0];
+	} });
+
+	cases.push_back({ "BackGroundRemover::normalizeImage (scalar)", frameBytes, 3, [&] {
+		setUseOptimized(false);
+		remover.normalizeImage(frame, normOut);
+		setUseOptimized(true);
+		sink += normOut.data[0];
+	} });
+
+	Mat histOut;
+	cases.push_back({ "BackGroundRemover::HistMethod", frameBytes, 500, [&] {
+		remover.HistMethod(normalized, histOut, true);
+		sink += histOut.data[0];
+	} });
+
+	Mat green, greenOut;
+	Chromaticity::green(frame, green);
+	remover.smoothImage(green, 5);
+	cases.push_back({ "BackGroundRemover::GreenHistMethod", green.total(), 500, [&] {
+		remover.GreenHistMethod(green, greenOut, true);
+		sink += greenOut.data[0];
+	} });
+
+	cases.push_back({ "BackGroundRemover::processFrame", frameBytes, 500, [&] {
+		Mat m = remover.processFrame(frame, 0);
+		sink += m.data[0];
+	} });
+
+	cases.push_back({ "Histogrammer::getHistMask", 256 * sizeof(float), 3, [&] {
+		MatND m = Histogrammer::getHistMask(smoothedHist);
+		sink += m.at<float>(0);
+	} });
+
+	cases.push_back({ "Histogrammer::backProj", frameBytes, 3, [&] {
+		Mat bp = Histogrammer::backProj(normalized, maskedHist, 1, true);
+		sink += bp.data[0];
+	} });
+
+	ContourAnalyzer contours;
+	vector<Rect> players;
+	vector<Point> balls;
+	cases.push_back({ "ContourAnalyzer::process", mask.total(), 3, [&] {
+		players.clear();
+		balls.clear();
+		contours.process(mask, players, balls);
+		sink += double(players.size() + balls.size());
+	} });
+
+	cases.push_back({ "ContourAnalyzer::processContours", mask.total(), 3, [&] {
+		players.clear();
+		balls.clear();
+		contours.processContours(mask, players, balls);
+		sink += double(players.size() + balls.size());
+	} });
+
+	vector<Point> matchPoints;
+	vector<double> matchValues;
+	cases.push_back({ "AppearanceAnalyzer::getMatches", size_t(ballCand.curRect.area()) * 3, 3, [&] {
+		appearance.setFrame(frame);
+		appearance.getMatches(&ballCand, 1, matchPoints, matchValues, 0);
+		if (!matchValues.empty()) sink += matchValues[0];
+	} });
+
+	// ----- a lost ball: with PYRAMID_SEARCH the window is searched at half resolution first -----
+	BallCandidate lostCand(0, Point(480, 300), Point(120, 90), 0.0);
+	cases.push_back({ "AppearanceAnalyzer::getMatches (240x180 window)", size_t(lostCand.curRect.area()) * 3, 3, [&] {
+		appearance.setFrame(frame);
+		appearance.getMatches(&lostCand, 1, matchPoints, matchValues, 0);
+		if (!matchValues.empty()) sink += matchValues[0];
+	} });
+
+	// ----- all ball windows of one frame: with SHARED_CORRELATION overlapping windows share the map -----
+	cases.push_back({ "AppearanceAnalyzer::getMatches (30 ball windows)", 0, 3, [&] {
+		appearance.setFrame(frame);
+		for (auto w : windows) {
+			appearance.getMatches(w, 1, matchPoints, matchValues, 0);
+			if (!matchValues.empty()) sink += matchValues[0];
+		}
+	} });
+
+	Mat peakCorr, peakWeight(ballCand.curRect.height - ballTempls.back().rows + 1, ballCand.curRect.width - ballTempls.back().cols + 1, CV_32FC1, Scalar(1.0));
+	matchTemplate(frame(ballCand.curRect), ballTempls.back(), peakCorr, CV_TM_CCORR_NORMED);
+	cases.push_back({ "PeakFinder::findPeaks (4 peaks, radius 12)", peakCorr.total() * sizeof(float), 3, [&] {
+		PeakFinder::findPeaks(peakCorr, peakWeight, 4, 12, matchPoints, matchValues);
+		sink += matchValues[0];
+	} });
+
+	// ----- one tile of the shared correlation, the largest template -----
+	const BallTemplateBank& ballBank = ModelRegistry::instance().getBallBank(3, 5, 0.5, Scalar(63, 98, 84));
+	int bankIdx = ballBank.size() - 1;
+	Size bankTempl = ballBank[bankIdx].image.size();
+	Mat tileSrc = frame(Rect(400, 250, CorrelationCache::TILE + bankTempl.width - 1, CorrelationCache::TILE + bankTempl.height - 1)), tileCorr;
+	cases.push_back({ "BallTemplateBank::match (32x32 positions)", tileSrc.total() * 3, 3, [&] {
+		ballBank.match(tileSrc, bankIdx, tileCorr);
+		sink += tileCorr.at<float>(0);
+	} });
+
+	cases.push_back({ "matchTemplate (32x32 positions)", tileSrc.total() * 3, 3, [&] {
+		matchTemplate(tileSrc, ballBank[bankIdx].image, tileCorr, CV_TM_CCORR_NORMED);
+		sink += tileCorr.at<float>(0);
+	} });
+
+	SmallTemplateMatcher smallMatcher(ballBank[bankIdx].image);
+	cases.push_back({ "SmallTemplateMatcher::match (32x32 positions)", tileSrc.total() * 3, 3, [&] {
+		smallMatcher.match(tileSrc, tileCorr);
+		sink += tileCorr.at<float>(0);
+	} });
+
+	// ----- the same ball windows with the tiles matched by OpenCV (the other cases use the default backend) -----
+	cases.push_back({ "AppearanceAnalyzer::getMatches (30 ball windows, OpenCV)", 0, 3, [&] {
+		appearance.setMatchBackend(MATCH_OPENCV);
+		appearance.setFrame(frame);
+		for (auto w : windows) {
+			appearance.getMatches(w, 1, matchPoints, matchValues, 0);
+			if (!matchValues.empty()) sink += matchValues[0];
+		}
+		appearance.setMatchBackend(defaultBackend);
+	} });
+
+	if (appearance.getTeamID(playerRect) >= 0)
+	{
+		cases.push_back({ "AppearanceAnalyzer::getTeamID", size_t(playerRect.area()) * 3, 3, [&] {
+			sink += appearance.getTeamID(playerRect);
+		} });
+	}
+	else
+	{
+		printf("AppearanceAnalyzer::getTeamID skipped: classifier.xml / Referee.xml not found\n");
+	}
+
+	// ----- three blobs of two merged players each -----
+	OcclusionSolver occlusion;
+	occlusion.setTeamModel(ModelRegistry::instance().getTeamModel(), fSize.y);
+	vector<PlayerCandidate*> occluded;
+	for (int g = 0; g < 3; g++) {
+		Rect blob(150 + 250 * g, 250, 60, 70), player(165 + 250 * g, 265, 28, 55);
+		occluded.push_back(new PlayerCandidate(0, Point(blob.x + blob.width / 2, blob.br().y), blob, g % 2, false));
+		occluded.push_back(new PlayerCandidate(0, Point(player.x + player.width / 2, player.br().y), player, (g + 1) % 2, false));
+		occluded.back()->prevRects.assign(2, player);
+	}
+	vector<pair<Point, Rect>> occludedStart;
+	for (auto p : occluded) occludedStart.push_back(make_pair(p->curCrd, p->curRect));
+	cases.push_back({ "OcclusionSolver::solve (3 groups)", 0, 3, [&] {
+		for (size_t i = 0; i < occluded.size(); i++) {
+			occluded[i]->curCrd = occludedStart[i].first;
+			occluded[i]->curRect = occludedStart[i].second;
+		}
+		occlusion.solve(occluded, frame, mask);
+		sink += occluded[0]->curCrd.x;
+	} });
+
+	cases.push_back({ "Tracker::merge_ (30 ball windows)", 0, 3, [&] {
+		auto groups = tracker.merge_(windows, &Tracker::compareMerge_Window);
+		sink += double(groups.size());
+	} });
+
+	cases.push_back({ "MultiCameraTracker::Triangulate", 0, 3, [&] {
+		sink += mcTracker.Triangulate(camTop, ballTop, camBtm, ballBtm).first;
+	} });
+
+	cases.push_back({ "ProjCandidate::update", 0, 3, [&] {
+		projCand.update(trackInfo, projFrame++, false);
+		sink += projCand.coords.back().x;
+	} });
+
+	// ---------- run the selected ones ----------
+	printf("chromaticity kernel: %s\n", Chromaticity::kernelName());
+	printf("small template kernel: %s\n", smallMatcher.kernelName());
+
+	// ---------- parity with CV_TM_CCORR_NORMED over every ball template, inside the frame and at its right edge ----------
+	double smallDiff = 0, bankDiff = 0;
+	Mat refCorr, testCorr;
+	Rect parityBlocks[] = { Rect(Point(400, 250), tileSrc.size()), Rect(Point(frame.cols - tileSrc.cols, 0), tileSrc.size()) };
+	for (const Rect& block : parityBlocks)
+	{
+		for (int i = 0; i < ballBank.size(); i++)
+		{
+			matchTemplate(frame(block), ballBank[i].image, refCorr, CV_TM_CCORR_NORMED);
+			SmallTemplateMatcher(ballBank[i].image).match(frame(block), testCorr);
+			smallDiff = max(smallDiff, norm(testCorr, refCorr, NORM_INF));
+			ballBank.match(frame(block), i, testCorr);
+			bankDiff = max(bankDiff, norm(testCorr, refCorr, NORM_INF));
+		}
+	}
+	printf("max |diff| vs matchTemplate: SmallTemplateMatcher %.2e, BallTemplateBank %.2e\n", smallDiff, bankDiff);
+	printf("%-40s %10s %12s %10s %8s %8s %10s\n", "case", "calls", "ns/op", "MB/s", "new/op", "mat/op", "matKB/op");
+	for (auto& bc : cases)
+	{
+		bool selected = (argc < 2);
+		for (int i = 1; i < argc; i++) selected |= (bc.name.find(argv[i]) != string::npos);
+		if (selected) runCase(bc);
+	}
+
+	for (auto w : windows) delete w;
+	for (auto p : occluded) delete p;
+	return 0;
+}
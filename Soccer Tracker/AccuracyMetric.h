@@ -3,6 +3,7 @@
 #include <utility>
 #include <string>
 #include <deque>
+#include <cstdio>
 
 namespace st {
 
@@ -25,7 +26,7 @@ struct AccuracyMetric {
 
 	//=============================================================================================
 	AccuracyMetric () {
-		TP = 0; TN = 0; FP = 0; FN = 0; dist_norm = 0;
+		TP = 0; TN = 0; FP = 0; FN = 0; TG = 0; dist_norm = 0;
 	}
 
 	//=============================================================================================
@@ -86,6 +87,15 @@ struct AccuracyMetric {
 		//sprintf(buffer, "TP: %d / %d", TP, TG);
 		return buffer;
 	}
+
+	//=============================================================================================
+	std::string toString_summary () {
+		double recall    = (TP + FN == 0) ? 0.0 : double(TP) / double(TP + FN);
+		double precision = (TP + FP == 0) ? 0.0 : double(TP) / double(TP + FP);
+		char buffer[160];
+		sprintf(buffer, "TP: %d / %d, FN: %d, FP: %d, TN: %d, recall: %.3f, precision: %.3f", TP, TG, FN, FP, TN, recall, precision);
+		return buffer;
+	}
 };
 
 }
\ No newline at end of file
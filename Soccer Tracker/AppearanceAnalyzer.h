@@ -2,10 +2,17 @@
 
 #include <opencv/cv.h>
 #include <vector>
+#include <atomic>
+#include <mutex>
 #include "BallCandidate.h"
 #include "PlayerCandidate.h"
 #include "globalSettings.h"
 #include "BackGroundRemover.h"
+#include "PerspectiveModel.h"
+#include "CorrelationCache.h"
+#include "PeakFinder.h"
+#include "TeamFeature.h"
+#include "ModelRegistry.h"
 
 #include <iostream>
 
@@ -30,65 +37,196 @@ class AppearanceAnalyzer {
 	//_____________________________________________________________________________________________
 	private:
 
-		int eachTemplStripeH;
+		PerspectiveModel perspective; // template of the ball for every row
+		CorrelationCache correlation{ matchMethod }; // ball templates matched once per frame, shared by the candidates
 
 		Mat frame, restrictedArea;
-		Mat teamA, teamB;
-		Mat tmplate[3];
-		Mat referee;
+		const TeamModel* teams = NULL; // classifier and player templates
+		Mat playerMask; // foreground of the frame, the team colours are read under it
+		TeamPrototypes teamPrototypes; // compact team features of this camera
 
 		vector<Mat> ballTempls;
+		vector<float> ballRadii; // radius of every template, sub-pixel with a template bank
+
+		// ----- half resolution, for the coarse search of large windows -----
+		CorrelationCache coarseCorrelation{ matchMethod };
+		vector<Mat> coarseTempls;
+		Mat coarseFrame, coarseRestricted;
+		atomic<bool> coarseReady{ false };
+		mutex coarseMutex;
+
+		atomic<long long> searchedArea{ 0 }, searchedWindows{ 0 }; // template positions asked for by all ball windows
 		
 		static const int matchMethod = CV_TM_CCORR_NORMED;
 		// also such values as CV_TM_CCOEFF_NORMED, CV_TM_SQDIFF_NORMED can be used
+		static const int refineRad = 2; // full resolution neighbourhood of a coarse peak
 		int _count = 0;
 
+		//=========================================================================================
+		void prepareCoarse () {
+			// ---------- the first large window of a frame builds its half resolution image ----------
+			if (coarseReady.load(memory_order_acquire)) return;
+			lock_guard<mutex> lock(coarseMutex);
+			if (coarseReady.load(memory_order_relaxed)) return;
+			pyrDown(frame, coarseFrame);
+			coarseCorrelation.setFrame(coarseFrame);
+			coarseReady.store(true, memory_order_release);
+		}
+
+		//=========================================================================================
+		void searchCoarseToFine (int templIdx, Rect positions, int dotsCnt, int nmsRadius, vector<Point>& corners, vector<double>& values) {
+			// ---------- the best template corners inside positions (frame coordinates) ----------
+			prepareCoarse();
+			Mat& templ = ballTempls[templIdx];
+			Mat& coarseTempl = coarseTempls[templIdx];
+			Point half(templ.cols/2, templ.rows/2), coarseHalf(coarseTempl.cols/2, coarseTempl.rows/2);
+
+			// ---------- 1) the window at half resolution, its centers halved ----------
+			Rect centers(positions.tl() + half, positions.size());
+			Rect coarsePos(Point(centers.x/2, centers.y/2) - coarseHalf, Point((centers.br().x - 1)/2 + 1, (centers.br().y - 1)/2 + 1) - coarseHalf);
+			coarsePos &= Rect(0, 0, coarseFrame.cols - coarseTempl.cols + 1, coarseFrame.rows - coarseTempl.rows + 1);
+
+			vector<Point> coarsePeaks;
+			vector<double> coarseValues;
+			Mat coarseCorr = coarseCorrelation.getMap(templIdx, coarsePos);
+			if (!coarseCorr.empty()) {
+				Mat coarseWeight = coarseRestricted(coarsePos + coarseHalf - Point(1, 1));
+				PeakFinder::findPeaks(coarseCorr, coarseWeight, PYRAMID_PEAKS * dotsCnt, std::max(coarseHalf.x, nmsRadius/2), coarsePeaks, coarseValues);
+			}
+
+			// ---------- 2) every coarse peak refined at full resolution in its neighbourhood ----------
+			vector<pair<double, Point>> refined;
+			for (auto& cp : coarsePeaks) {
+				Point corner = (cp + coarsePos.tl() + coarseHalf) * 2 - half;
+				Rect around = Rect(corner - Point(refineRad, refineRad), Size(2*refineRad + 1, 2*refineRad + 1)) & positions;
+				if (around.area() <= 0) continue;
+
+				Mat corr;
+				correlation.match(templIdx, frame(Rect(around.tl(), around.size() + templ.size() - Size(1, 1))), corr);
+				vector<Point> p;
+				vector<double> v;
+				PeakFinder::findPeaks(corr, restrictedArea(around + half - Point(1, 1)), 1, 0, p, v);
+				if (!p.empty()) refined.push_back(make_pair(v[0], p[0] + around.tl()));
+			}
+			stable_sort(refined.begin(), refined.end(), [](const pair<double, Point>& a, const pair<double, Point>& b) { return a.first > b.first; });
+
+			// ----- neighbourhoods may overlap: keep the distinct ones -----
+			corners.clear();
+			values.clear();
+			for (auto& r : refined) {
+				if (int(corners.size()) == dotsCnt) break;
+				bool distinct = true;
+				for (auto& c : corners) {
+					if (abs(c.x - r.second.x) <= nmsRadius && abs(c.y - r.second.y) <= nmsRadius) distinct = false;
+				}
+				if (distinct) {
+					corners.push_back(r.second);
+					values.push_back(r.first);
+				}
+			}
+		}
+
+		//=========================================================================================
+		void setCoarseTempls () {
+			coarseTempls.clear();
+			for (auto& t : ballTempls) {
+				Mat coarse;
+				pyrDown(t, coarse);
+				coarseTempls.push_back(coarse);
+			}
+			coarseCorrelation.setTemplates(coarseTempls);
+		}
+
 	//_____________________________________________________________________________________________
 	public:
 
 		//=========================================================================================
 		void setBallTempls (vector<Mat>& ballTempls) {
-			this->ballTempls = ballTempls;
-			if (!ballTempls.empty()) {
-				eachTemplStripeH = fSize.y / ballTempls.size();
+			ballRadii.clear();
+			for (auto& t : ballTempls) {
+				ballRadii.push_back(float((t.rows - 1) / 2));
 			}
+			this->ballTempls = ballTempls;
+			perspective.setBallTemplates(ballRadii);
+			correlation.setTemplates(ballTempls);
+			setCoarseTempls();
 		}
-		//=========================================================================================
-		void generateClassifier() {
 
-			Mat temp;
-
-			FileStorage aa("classifier.xml", FileStorage::READ);
-			aa["some_name"] >> temp;
-			aa.release();
+		//=========================================================================================
+		void setBallBank (const BallTemplateBank& bank) {
+			// ----- shared by all cameras, owned by the registry; the tiles are matched with its spectra -----
+			ballTempls = bank.getImages();
+			ballRadii = bank.getRadii();
+			perspective.setBallTemplates(ballRadii);
+			correlation.setTemplates(ballTempls, &bank);
+			setCoarseTempls();
+		}
 
-			temp.row(0).copyTo(teamA);
-			temp.row(1).copyTo(teamB);
-			temp.release();
+		//=========================================================================================
+		void setPerspective (const PerspectiveModel& model) {
+			perspective = model;
+			perspective.setBallTemplates(ballRadii);
+		}
 
-			FileStorage bb("Referee.xml", FileStorage::READ);
-			bb["Referee"] >> temp;
+		//=========================================================================================
+		void setMatchBackend (MATCH_BACKEND backend) {
+			// ----- how the ball templates are matched, at both resolutions -----
+			correlation.setBackend(backend);
+			coarseCorrelation.setBackend(backend);
+		}
 
-			temp.copyTo(referee);
+		//=========================================================================================
+		MATCH_BACKEND getMatchBackend () {
+			return correlation.getBackend();
+		}
 
-			temp.release();
+		//=========================================================================================
+		const PerspectiveModel& getPerspective () {
+			return perspective;
+		}
 
-			tmplate[0] = imread("White.png");
-			tmplate[1] = imread("Blue.png");
-			tmplate[2] = imread("Referee.png");
+		//=========================================================================================
+		void setTeamModel (const TeamModel& teams) {
+			// ----- shared by all cameras, owned by the registry -----
+			this->teams = &teams;
 		}
 
 		//=========================================================================================
 		void setFrame (Mat& frame) {
 			this->frame = frame;
+			correlation.setFrame(frame);
+			coarseReady = false;
 		}
+		//=========================================================================================
+		void setPlayerMask (Mat& mask) {
+			playerMask = mask;
+		}
+
 		//=========================================================================================
 		void setRestrictedArea (Mat& restrictedArea) {
 			this->restrictedArea = restrictedArea;
+			resize(restrictedArea, coarseRestricted, Size((restrictedArea.cols + 1)/2, (restrictedArea.rows + 1)/2), 0, 0, INTER_NEAREST);
 		}
 
 		//=========================================================================================
-		void getMatches (BallCandidate* cand, int dotsCnt, vector<Point>& points, vector<double>& values, int TID = 0) {
+		CorrelationCache& getCorrelation () {
+			return correlation;
+		}
+
+		//=========================================================================================
+		long long getSearchedArea () {
+			return searchedArea;
+		}
+
+		//=========================================================================================
+		long long getSearchedWindows () {
+			return searchedWindows;
+		}
+
+		//=========================================================================================
+		void getMatches (BallCandidate* cand, int dotsCnt, vector<Point>& points, vector<double>& values, int TID = 0, int nmsRadius = 0) {
+			// ---------- up to dotsCnt distinct peaks, best first; none if the window is smaller than the
+			// ---------- template, fewer if the rest is suppressed (callers check for empty) ----------
 
 			// Set limits
 			Rect bounds(0, 0, frame.cols, frame.rows);
@@ -103,11 +241,8 @@ class AppearanceAnalyzer {
 			//Mat temp = crop.clone();
 			Mat temp = crop;
 
-			// Gay condition
-			Mat RA_crop = restrictedArea(cand->curRect);
-
 			// ---------- choose appropriate template ----------
-			int templIdx = (cand->curCrd.y - 1) / eachTemplStripeH;
+			int templIdx = perspective.getTemplIdx(cand->curCrd.y);
 			
 			Mat ballTempl = ballTempls[templIdx];
 
@@ -118,52 +253,90 @@ class AppearanceAnalyzer {
 				return;
 			}
 
-			// Player mask
-			/*Mat restrictedMask = cand->restrictedMask;
+			// ----- the restricted area is read under the center of the template -----
+			Rect positions(cand->curRect.x, cand->curRect.y, crop.cols - ballTempl.cols + 1, crop.rows - ballTempl.rows + 1);
+			Mat RA_cropResized = restrictedArea(positions + Point(ballTempl.cols/2-1, ballTempl.rows/2-1));
+			searchedArea += positions.area();
+			searchedWindows++;
 
-			if (!restrictedMask.empty()) 
+#ifdef PYRAMID_SEARCH
+			// ---------- large windows (lost ball, ball at a player): coarse search, then refine; the whole
+			// ---------- window at full resolution if no coarse peak is left (window off the coarse frame) ----------
+			if (positions.area() > PYRAMID_MIN_AREA) 
 			{
-				multiply(temp, restrictedMask, temp);
-			}*/
-
-			Mat cropGr, corrMtrx, cropCVar;
-			matchTemplate(temp, ballTempl, corrMtrx, matchMethod);
-
-			Mat cropResized    = temp(Rect(ballTempl.cols/2-1, ballTempl.rows/2-1, temp.cols-ballTempl.cols+1, temp.rows-ballTempl.rows+1));
-			Mat RA_cropResized = RA_crop(Rect(ballTempl.cols/2-1, ballTempl.rows/2-1, temp.cols-ballTempl.cols+1, temp.rows-ballTempl.rows+1));
-
-			multiply(corrMtrx, RA_cropResized, corrMtrx);
-
-			double minVal, maxVal;
-			Point minLoc, maxLoc;
-
-			// Finds the coordinate with the highest CC score
-			for (int i = 0; i < dotsCnt; i++) 
+				searchCoarseToFine(templIdx, positions, dotsCnt, nmsRadius, points, values);
+				for (auto& p : points) 
+				{
+					p += Point(ballTempl.cols/2, ballTempl.rows/2) - positions.tl() + cand->LU_Point;
+				}
+				if (!points.empty()) return;
+			}
+#endif
+
+#ifdef SHARED_CORRELATION
+			// ---------- read the window from the shared map (same positions as the crop) ----------
+			Mat corrMtrx = correlation.getMap(templIdx, positions);
+#else
+			Mat corrMtrx;
+			correlation.match(templIdx, temp, corrMtrx);
+#endif
+
+			// Finds the coordinates with the highest CC scores
+			PeakFinder::findPeaks(corrMtrx, RA_cropResized, dotsCnt, nmsRadius, points, values);
+			for (auto& p : points) 
 			{
-				minMaxLoc(corrMtrx, &minVal, &maxVal, &minLoc, &maxLoc, Mat());
-				corrMtrx.at<float>(maxLoc) = -2.0;
-				maxLoc += Point(ballTempl.cols/2, ballTempl.rows/2) + cand->LU_Point;
-				points.push_back(maxLoc);
-				values.push_back(maxVal);
+				p += Point(ballTempl.cols/2, ballTempl.rows/2) + cand->LU_Point;
 			}
+		}
 
-			if (values.size() == 0 || points.size() == 0) {
-				int x = 0;
+		//=========================================================================================
+		int getTeamID (Rect player, double& confidence) {
+			// ---------- confidence: margin to the second nearest team. Without COMPACT_TEAM_FEATURE the
+			// ---------- classifier decides; with it the compact feature of the player's foreground is
+			// ---------- compared with the prototypes of this camera. Until they are made the classifier
+			// ---------- decides (confidence 0, so the player is checked again) and its clear decisions are
+			// ---------- the samples of the prototypes ----------
+			confidence = 0.0;
+			Rect tempRect = player & Rect(0, 0, frame.cols, frame.rows);
+			if (tempRect.area() == 0) return -1;
+
+			#ifndef COMPACT_TEAM_FEATURE
+			return classifierTeamID(tempRect, confidence);
+			#else
+			float feature[TeamFeature::BINS];
+			TeamFeature::compute(frame(tempRect), playerMask.empty() ? Mat() : playerMask(tempRect), feature);
+
+			double margin;
+			if (teamPrototypes.ready()) {
+				int team = teamPrototypes.classify(feature, confidence);
+				if (teamPrototypes.comparing()) teamPrototypes.compare(team, classifierTeamID(tempRect, margin));
+				return team;
 			}
+			int team = classifierTeamID(tempRect, margin);
+			if (team >= 0 && margin >= TEAM_SAMPLE_MARGIN) teamPrototypes.addSample(team, feature);
+			return team;
+			#endif
 		}
 
 		//=========================================================================================
 		int getTeamID(Rect player)
 		{
-			Rect bounds(0, 0, frame.cols, frame.rows);
-			Rect tempRect = player & bounds;
+			double confidence;
+			return getTeamID(player, confidence);
+		}
+
+		//=========================================================================================
+		int classifierTeamID (Rect tempRect, double& margin)
+		{
+			// ---------- nearest mean player of classifier.xml; margin to the second nearest one ----------
+			margin = 0.0;
 
 			// Resize Player to (20 x 45)
 			Mat temp = frame(tempRect);
 			Mat player_RGB = temp.clone();
 
 			// Exit if Mat is empty
-			if (player_RGB.empty()) return -1;
+			if (player_RGB.empty() || teams == NULL || teams->teamA.empty()) return -1;
 
 			// Else Classify
 			else
@@ -189,15 +362,25 @@ class AppearanceAnalyzer {
 
 				// Classify
 				vector<float> dist;
-				dist.push_back(norm(featureVector, teamA, NORM_L2));
-				dist.push_back(norm(featureVector, teamB, NORM_L2));
-				dist.push_back(norm(featureVector, referee, NORM_L2));
-
-				return std::min_element(dist.begin(), dist.end()) - dist.begin();
-
+				dist.push_back(norm(featureVector, teams->teamA, NORM_L2));
+				dist.push_back(norm(featureVector, teams->teamB, NORM_L2));
+				dist.push_back(norm(featureVector, teams->referee, NORM_L2));
+
+				int best = int(std::min_element(dist.begin(), dist.end()) - dist.begin());
+				float second = FLT_MAX;
+				for (int t = 0; t < 3; t++) {
+					if (t != best) second = std::min(second, dist[t]);
+				}
+				margin = (second > 0) ? (second - dist[best]) / second : 0.0;
+				return best;
 			}
 		}
 
+		//=========================================================================================
+		TeamPrototypes& getTeamPrototypes () {
+			return teamPrototypes;
+		}
+
 		void segmentPlayer(vector<PlayerCandidate*> pCandidates, Rect _overlappedRoi, Mat& _frame, int TID, Mat _mask) {
 			
 			// Set limits
@@ -228,7 +411,7 @@ class AppearanceAnalyzer {
 				Rect prevRect = Rect(0, 0, (10 * overlappedRoi.br().y / 540) + 25, (30 * overlappedRoi.br().y / 540) + 25) & limit;
 				
 				// Resize template to size of bounding box
-				Mat playerTmplate = tmplate[pCandidates[i]->teamID].clone();
+				Mat playerTmplate = teams->tmplate[pCandidates[i]->teamID].clone();
 				resize(playerTmplate, playerTmplate, Size(prevRect.width, prevRect.height));	
 
 				// Split template to bgr
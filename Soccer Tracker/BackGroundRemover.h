@@ -4,15 +4,32 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv/highgui.h>
+#include <cstdio>
+#include <cstring>
 
 #include "histogrammer.h"
 #include "globalSettings.h"
+#include "StageProfiler.h"
+#include "Chromaticity.h"
+#include "HistogramAccumulator.h"
+#include "FieldRegion.h"
 
 using namespace cv;
 using namespace std;
 
 namespace st {
 
+//*************************************************************************************************
+// ----- Copy of the background model that can be written to disk while the segmentation goes on
+//*************************************************************************************************
+struct BackgroundSnapshot {
+
+	int bins, frames;
+	MatND model, maskModel, maskedHist;
+	Mat backProjLut;
+	bool maskValid;
+};
+
 //*************************************************************************************************
 // ----- This class is used to perform B/F segmentation (the version with normalizing image)
 //*************************************************************************************************
@@ -20,25 +37,42 @@ class BackGroundRemover {
 
 	//________________________________________________________________________________________________
 	private:
-		int accumSize, bins, smoothSize;
+		int bins, smoothSize;
 		int channels[1], numOfBins[1];
 		float hrangers[2];
 		const float* ranges[1];
-		vector<MatND> allHists;
-		deque<MatND> accum;
+		HistogramAccumulator accumulator;
 		bool applyMorphologic;
-		Mat normalizedFrame, morphElem, resultMask;
+		Mat normalizedFrame, greenFrame, morphElem, resultMask;
+		vector<int> valueBin; // histogram bin of every 8-bit value, -1 if calcHist skips it
+
+		// ----- only the pitch is segmented: its row spans, and the wider spans the blur reads -----
+		FieldRegion region;
+		vector<int> readL, readR;
+		Rect readBounds;
+
+		// ----- the mask of the pitch peaks is rebuilt only when the accumulated model drifts away -----
+		MatND maskModel, maskedHist, sceneModel;
+		Mat backProjLut;
+		bool maskValid;
+		double driftDistance, sceneCutDistance; // Bhattacharyya distances
+		int maskRebuilds, sceneCuts;
 
 	//________________________________________________________________________________________________
 	public:
 
 		//=========================================================================================
-		BackGroundRemover (int accumSize, int bins, int smoothSize, bool applyMorphologic = false) {
+		BackGroundRemover (int accumSize, int bins, int smoothSize, bool applyMorphologic = false) : accumulator(bins, accumSize) {
 			this->applyMorphologic = applyMorphologic;
-			this->accumSize = accumSize;
 			this->bins = bins;
 			this->smoothSize = smoothSize;
 			numOfBins[0] = bins;
+
+			maskValid = false;
+			driftDistance = 0.03;
+			sceneCutDistance = 0.4;
+			maskRebuilds = 0;
+			sceneCuts = 0;
 		
 			channels[0] = 1;
 
@@ -47,7 +81,24 @@ class BackGroundRemover {
 			ranges[0] = hrangers;
 
 			normalizedFrame = Mat::zeros(fSize, CV_8UC3);
+			greenFrame = Mat::zeros(fSize, CV_8UC1);
 			resultMask = Mat::zeros(fSize, CV_8UC1);
+			setFieldRegion(FieldRegion(Size(fSize)));
+
+			// ----- ask calcHist itself where every value goes, so the fused path bins exactly like it -----
+			valueBin.assign(256, -1);
+			int channel0[1] = { 0 };
+			for (int v = 0; v < 256; v++) {
+				Mat pixel(1, 1, CV_8UC1, Scalar(v));
+				MatND hist;
+				calcHist(&pixel, 1, channel0, Mat(), hist, 1, numOfBins, ranges);
+				double maxVal;
+				Point maxLoc;
+				minMaxLoc(hist, NULL, &maxVal, NULL, &maxLoc);
+				if (maxVal > 0) {
+					valueBin[v] = maxLoc.y;
+				}
+			}
 
 			if (applyMorphologic) {
 				morphElem = Mat::ones(3, 3, CV_8U);
@@ -61,13 +112,34 @@ class BackGroundRemover {
 		//=========================================================================================
 		Mat processFrame (Mat& frame, int TID) {
 
+			#ifdef FUSED_GREEN_SEGMENTATION
+			// ----- only the green chromaticity of the pitch is segmented, nothing else is normalized or smoothed -----
+			Mat segmented = greenFrame(readBounds);
+			StageTimer normalizeTimer(TID, STAGE_NORMALIZE);
+			for (int y = readBounds.y; y < readBounds.y + readBounds.height; y++) {
+				if (readL[y] < readR[y]) {
+					Chromaticity::green(frame.ptr<uchar>(y) + 3 * readL[y], greenFrame.ptr<uchar>(y) + readL[y], readR[y] - readL[y]);
+				}
+			}
+			#else
+			Mat& segmented = normalizedFrame;
+			StageTimer normalizeTimer(TID, STAGE_NORMALIZE);
 			normalizeImage(frame, normalizedFrame);
+			#endif
+			normalizeTimer.stop();
 
-			if (smoothSize != -1) {
-				smoothImage(normalizedFrame, smoothSize);
+			if (smoothSize != -1 && !segmented.empty()) {
+				StageTimer smoothTimer(TID, STAGE_SMOOTH);
+				smoothImage(segmented, smoothSize);
 			}
 
+			StageTimer histTimer(TID, STAGE_HIST_METHOD);
+			#ifdef FUSED_GREEN_SEGMENTATION
+			GreenHistMethod(greenFrame, resultMask, true);
+			#else
 			HistMethod(normalizedFrame, resultMask, true, TID);
+			#endif
+			histTimer.stop();
 
 			if (applyMorphologic) {
 				applyMorphological(resultMask, resultMask);
@@ -78,42 +150,195 @@ class BackGroundRemover {
 			return resultMask;
 		}
 
+		//=========================================================================================
+		void setFieldRegion (const FieldRegion& fieldRegion) {
+			// ---------- the blur of a span reads smoothSize / 2 pixels around it, those are normalized too ----------
+			region = fieldRegion;
+			int r = (smoothSize != -1) ? smoothSize / 2 : 0;
+			int fH = fSize.y, fW = fSize.x;
+
+			readL.assign(fH, fW);
+			readR.assign(fH, 0);
+			int top = fH, bottom = -1, left = fW, right = 0;
+			for (int y = 0; y < fH; y++) {
+				for (int dy = std::max(y - r, 0); dy <= std::min(y + r, fH - 1); dy++) {
+					if (region.getSpanL(dy) < region.getSpanR(dy)) {
+						readL[y] = std::min(readL[y], std::max(region.getSpanL(dy) - r, 0));
+						readR[y] = std::max(readR[y], std::min(region.getSpanR(dy) + r, fW));
+					}
+				}
+				if (readL[y] < readR[y]) {
+					top = std::min(top, y);
+					bottom = y;
+					left = std::min(left, readL[y]);
+					right = std::max(right, readR[y]);
+				}
+			}
+			readBounds = (bottom >= 0) ? Rect(left, top, right - left, bottom - top + 1) : Rect();
+			resultMask = Scalar(0);
+		}
+
+		//=========================================================================================
+		FieldRegion& getFieldRegion () {
+			return region;
+		}
+
 		//=========================================================================================
 		void updateAccumulator (MatND& srcHist, MatND& accumulatedHist) {
-			accum.push_back(srcHist.clone());
-			int lh = int(accum.size());
-			if (lh > accumSize) {
-				accum.pop_front();
-				lh--;
+			accumulator.add(srcHist);
+			accumulator.getModel(accumulatedHist);
+		}
+
+		//=========================================================================================
+		HistogramAccumulator& getAccumulator () {
+			return accumulator;
+		}
+
+		//=========================================================================================
+		void setDriftThresholds (double driftDistance, double sceneCutDistance) {
+			this->driftDistance = driftDistance;
+			this->sceneCutDistance = sceneCutDistance;
+			maskValid = false;
+		}
+
+		//=========================================================================================
+		int getBins () {
+			return bins;
+		}
+
+		//=========================================================================================
+		BackgroundSnapshot getModelSnapshot () {
+			// ---------- accumulated background and the mask derived from it (copies) ----------
+			BackgroundSnapshot snapshot;
+			snapshot.bins = bins;
+			snapshot.frames = accumulator.getSize();
+			accumulator.getModel(snapshot.model);
+			snapshot.model = snapshot.model.clone();
+			snapshot.maskValid = maskValid;
+			if (maskValid) {
+				snapshot.maskModel = maskModel.clone();
+				snapshot.maskedHist = maskedHist.clone();
+				snapshot.backProjLut = backProjLut.clone();
 			}
-			Mat sum = MatND::zeros(bins, 1, CV_32FC1);
-			for (deque<MatND>::iterator itr = accum.begin(); itr != accum.end(); itr++) {
-				sum += *itr;
+			return snapshot;
+		}
+
+		//=========================================================================================
+		static void saveModel (string fileName, string key, const BackgroundSnapshot& snapshot) {
+			// ---------- written to a temporary file first so a crash while saving does not destroy
+			// ---------- the previous one ----------
+			string tmpName = fileName + ".tmp";
+			FileStorage storage(tmpName, FileStorage::WRITE);
+			if (!storage.isOpened()) {
+				return;
+			}
+			storage << "key" << key;
+			storage << "bins" << snapshot.bins;
+			storage << "frames" << snapshot.frames;
+			storage << "model" << snapshot.model;
+			if (snapshot.maskValid) {
+				storage << "maskModel" << snapshot.maskModel;
+				storage << "maskedHist" << snapshot.maskedHist;
+				storage << "backProjLut" << snapshot.backProjLut;
 			}
-			sum /= lh;
-			accumulatedHist = sum;
+			storage.release();
+
+			remove(fileName.c_str());
+			rename(tmpName.c_str(), fileName.c_str());
 		}
 
 		//=========================================================================================
-		void HistMethod (Mat& frame, Mat& binMask, bool withAccumulator = true, int TID = 0) {
-			
-			// calculate hist for green channel of normalized image
-			MatND histG;
-			calcHist(&frame, 1, channels, Mat(), histG, 1, numOfBins, ranges);
-			MatND hMask = MatND::ones(bins, 1, CV_32FC1);
-			
+		void saveModel (string fileName, string key) {
+			saveModel(fileName, key, getModelSnapshot());
+		}
+
+		//=========================================================================================
+		bool loadModel (string fileName, string key) {
+			// ---------- start from a saved background of the same camera, region and bins (key) ----------
+			FileStorage storage(fileName, FileStorage::READ);
+			if (!storage.isOpened()) {
+				return false;
+			}
+			string savedKey;
+			int savedBins = 0, frames = 0;
+			MatND model;
+			storage["key"] >> savedKey;
+			storage["bins"] >> savedBins;
+			storage["frames"] >> frames;
+			storage["model"] >> model;
+			if (savedKey != key || savedBins != bins || frames <= 0 || int(model.total()) != bins) {
+				return false;
+			}
+			accumulator.setModel(model, frames);
+
+			maskValid = false;
+			storage["maskModel"] >> maskModel;
+			storage["maskedHist"] >> maskedHist;
+			storage["backProjLut"] >> backProjLut;
+			if (int(maskModel.total()) == bins && int(maskedHist.total()) == bins && backProjLut.total() == 256) {
+				maskValid = true;
+			}
+			return true;
+		}
+
+		//=========================================================================================
+		int getMaskRebuilds () {
+			return maskRebuilds;
+		}
+
+		//=========================================================================================
+		int getSceneCuts () {
+			return sceneCuts;
+		}
+
+		//=========================================================================================
+		void maskPitchPeaks (MatND& histG, bool withAccumulator) {
+			// ---------- accumulate the histogram and remove the peaks of the pitch from it.
+			// ---------- On return histG is the masked model, the LUT of the backprojection is ready ----------
 			if (withAccumulator) {
-				allHists.push_back(histG.clone());
-				if (isTheSameScene(histG)) {
-					updateAccumulator(histG, histG);
+				if (!isTheSameScene(histG)) {
+					// ----- a cut: the old background says nothing about the new view -----
+					accumulator.clear();
+					maskValid = false;
+					sceneCuts++;
 				}
+				updateAccumulator(histG, histG);
+			} else {
+				maskValid = false;
 			}
 
-			MatND smoothedHistG = Histogrammer::filterHist(histG);
-			MatND histMask = Histogrammer::getHistMask(smoothedHistG);
+			if (!maskValid || compareHist(histG, maskModel, CV_COMP_BHATTACHARYYA) > driftDistance) {
+				histG.copyTo(maskModel);
+
+				MatND smoothedHistG = Histogrammer::filterHist(histG);
+				MatND histMask = Histogrammer::getHistMask(smoothedHistG);
+				multiply(histG, histMask, maskedHist);
 
-			multiply(histG, histMask, histG);
+				// ----- a value is foreground if its bin backprojects (as calcBackProject does) to a non-zero byte -----
+				MatND histN;
+				normalize(maskedHist, histN, 0, 255, NORM_MINMAX, -1, Mat());
+				backProjLut.create(1, 256, CV_8UC1);
+				for (int v = 0; v < 256; v++) {
+					bool foreground = (valueBin[v] >= 0) && (saturate_cast<uchar>(histN.at<float>(valueBin[v])) > 0);
+					backProjLut.at<uchar>(v) = foreground ? 255 : 0;
+				}
+
+				maskValid = true;
+				maskRebuilds++;
+			}
+			histG = maskedHist;
+		}
+
+		//=========================================================================================
+		void HistMethod (Mat& frame, Mat& binMask, bool withAccumulator = true, int TID = 0) {
+			
+			// calculate hist for green channel of normalized image
+			MatND histG;
+			calcHist(&frame, 1, channels, region.getMask(), histG, 1, numOfBins, ranges);
+
+			maskPitchPeaks(histG, withAccumulator);
 			binMask = Histogrammer::backProj(frame, histG, 1, true);
+			bitwise_and(binMask, region.getMask(), binMask);
 
 			//if (TID == 3)
 			//{
@@ -138,6 +363,54 @@ class BackGroundRemover {
 			imshow("s", getSkeleton(binMask));*/
 		}
 
+		//=========================================================================================
+		void GreenHistMethod (Mat& green, Mat& binMask, bool withAccumulator = true) {
+			// ---------- HistMethod on the green chromaticity alone (CV_8UC1): the histogram takes one
+			// ---------- pass over the field region, backprojection and threshold become one table lookup ----------
+			CV_Assert(green.rows == fSize.y && green.cols == fSize.x);
+			int counts[4][256] = {};	// 4 partial histograms, so neighbouring equal values do not stall
+			for (int y = 0; y < green.rows; y++) {
+				const uchar* p = green.ptr<uchar>(y);
+				int j = region.getSpanL(y), end = region.getSpanR(y);
+				for (; j + 4 <= end; j += 4) {
+					counts[0][p[j]]++;
+					counts[1][p[j + 1]]++;
+					counts[2][p[j + 2]]++;
+					counts[3][p[j + 3]]++;
+				}
+				for (; j < end; j++) {
+					counts[0][p[j]]++;
+				}
+			}
+
+			vector<int> binCounts(bins, 0);
+			for (int v = 0; v < 256; v++) {
+				if (valueBin[v] >= 0) {
+					binCounts[valueBin[v]] += counts[0][v] + counts[1][v] + counts[2][v] + counts[3][v];
+				}
+			}
+			MatND histG(bins, 1, CV_32FC1);
+			for (int b = 0; b < bins; b++) {
+				histG.at<float>(b) = float(binCounts[b]);
+			}
+
+			maskPitchPeaks(histG, withAccumulator);
+
+			// ----- off the pitch the mask stays 0 -----
+			binMask.create(green.size(), CV_8UC1);
+			const uchar* lut = backProjLut.ptr<uchar>();
+			for (int y = 0; y < green.rows; y++) {
+				const uchar* p = green.ptr<uchar>(y);
+				uchar* m = binMask.ptr<uchar>(y);
+				int l = std::min(region.getSpanL(y), region.getSpanR(y)), r = region.getSpanR(y);
+				memset(m, 0, l);
+				for (int x = l; x < r; x++) {
+					m[x] = lut[p[x]];
+				}
+				memset(m + r, 0, green.cols - r);
+			}
+		}
+
 		//=========================================================================================
 		/*IplImage* DrawHistogram(CvHistogram *hist, float scaleX = 1, float scaleY = 1)
 		{
@@ -187,39 +460,8 @@ class BackGroundRemover {
 
 		//=========================================================================================
 		inline void normalizeImage (Mat& input, Mat& output) {
-			
-			int b, g, r, s;
-
-			int fH = input.rows;
-			int fW = input.cols;
-
-			if (input.isContinuous() && output.isContinuous()) {
-				fW = fW * fH;
-				fH = 1;
-			}
-
-			for (int i = 0; i < fH; i++) 
-			{
-				uchar* inp = input.ptr<uchar>(i);
-				uchar* outp = output.ptr<uchar>(i);
-
-				for (int j = 0; j < fW; j++) 
-				{
-					b = *inp++;
-					g = *inp++;
-					r = *inp++;
-					s = r + g + b;
-
-					if (s == 0) 
-					{
-						s = 1;
-					}
-
-					*outp++ = 255 * b / s;
-					*outp++ = 255 * g / s;
-					*outp++ = 255 * r / s;
-				}
-			}
+			// ----- 255 * c / (b + g + r) for every channel, vectorized where the CPU allows it -----
+			Chromaticity::normalize(input, output);
 		}
 
 		//=========================================================================================
@@ -230,7 +472,12 @@ class BackGroundRemover {
 
 		//===============================================================================================
 		bool isTheSameScene (MatND& hist) {
-			return true;
+			// ----- the histogram of the frame against the accumulated background: far away means a cut -----
+			if (accumulator.getSize() == 0) {
+				return true;
+			}
+			accumulator.getModel(sceneModel);
+			return compareHist(hist, sceneModel, CV_COMP_BHATTACHARYYA) <= sceneCutDistance;
 		}
 
 		//===============================================================================================
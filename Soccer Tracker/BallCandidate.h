@@ -198,11 +198,16 @@ class BallCandidate {
 
 		//=========================================================================================
 		void fitFrame () {
+			fitFrame(curCrd);
+		}
+
+		//=========================================================================================
+		void fitFrame (Point center) {
 			// ---------- calculate the precise rectangle for search zone ----------
-			int left   = curCrd.x - curRad.x;
-			int right  = curCrd.x + curRad.x;
-			int up     = curCrd.y - curRad.y;
-			int down   = curCrd.y + curRad.y;
+			int left   = center.x - curRad.x;
+			int right  = center.x + curRad.x;
+			int up     = center.y - curRad.y;
+			int down   = center.y + curRad.y;
 
 			up = int(std::max(double(up), 0.0));
 			down = int(std::min(double(down), double(fSize.y-1)));
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+
+#include "TemplateGenerator.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- One ball template with everything CV_TM_CCORR_NORMED needs from it: its norm, its mean and
+// ----- the spectra of its channels at the transform size of a block of positions
+//*************************************************************************************************
+struct BallTemplate {
+
+	float radius;
+	Mat image;				// CV_8UC3
+	double norm;			// sqrt of the sum of squares over all channels
+	Scalar mean;
+	Size dftSize;			// of a block of positions plus the template
+	Mat spectrum[3];		// CV_32FC1, packed (CCS) spectra of B, G, R
+};
+
+//*************************************************************************************************
+// ----- The ball templates of one camera, from minRad to maxRad in steps (sub-pixel radii), made
+// ----- once with their statistics. match() gives the same values as matchTemplate with
+// ----- CV_TM_CCORR_NORMED for blocks of up to blockSize positions, but only the image is
+// ----- transformed: the three channel products are summed in the frequency domain and
+// ----- transformed back once, and the template terms are not computed again on every call
+//*************************************************************************************************
+class BallTemplateBank {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		vector<BallTemplate> templates;
+		Size blockSize;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		BallTemplateBank () {}
+
+		//=========================================================================================
+		BallTemplateBank (double minRad, double maxRad, double step, Scalar backGrColor, Size blockSize) : blockSize(blockSize) {
+			// ---------- minRad, minRad + step, ... up to maxRad (included) ----------
+			step = std::max(step, 0.1);
+			for (double rad = minRad; rad <= maxRad + 1e-6; rad += step) {
+				BallTemplate t;
+				t.radius = float(rad);
+				t.image = TemplateGenerator::createBallTemple(rad, 1, backGrColor);
+
+				Scalar sdv;
+				meanStdDev(t.image, t.mean, sdv);
+				double sq = 0;
+				for (int c = 0; c < 3; c++) {
+					sq += sdv[c] * sdv[c] + t.mean[c] * t.mean[c];
+				}
+				t.norm = sqrt(sq * t.image.total());
+
+				t.dftSize = Size(getOptimalDFTSize(blockSize.width + t.image.cols - 1), getOptimalDFTSize(blockSize.height + t.image.rows - 1));
+				vector<Mat> planes;
+				split(t.image, planes);
+				for (int c = 0; c < 3; c++) {
+					Mat padded = Mat::zeros(t.dftSize, CV_32FC1);
+					planes[c].convertTo(padded(Rect(0, 0, t.image.cols, t.image.rows)), CV_32F);
+					dft(padded, t.spectrum[c], 0, t.image.rows);
+				}
+				templates.push_back(t);
+			}
+		}
+
+		//=========================================================================================
+		int size () const {
+			return int(templates.size());
+		}
+
+		//=========================================================================================
+		const BallTemplate& operator[] (int idx) const {
+			return templates[idx];
+		}
+
+		//=========================================================================================
+		vector<Mat> getImages () const {
+			vector<Mat> images;
+			for (auto& t : templates) images.push_back(t.image);
+			return images;
+		}
+
+		//=========================================================================================
+		vector<float> getRadii () const {
+			vector<float> radii;
+			for (auto& t : templates) radii.push_back(t.radius);
+			return radii;
+		}
+
+		//=========================================================================================
+		void match (const Mat& src, int idx, Mat& result) const {
+			// ---------- src: CV_8UC3; result: CV_32FC1 (reused if it has the right size) ----------
+			const BallTemplate& t = templates[idx];
+			Size positions(src.cols - t.image.cols + 1, src.rows - t.image.rows + 1);
+			if (positions.width <= 0 || positions.height <= 0 || positions.width > blockSize.width || positions.height > blockSize.height) {
+				// ----- larger than the transforms were made for -----
+				matchTemplate(src, t.image, result, CV_TM_CCORR_NORMED);
+				return;
+			}
+
+			// ---------- sum over the channels of image (x) template, one inverse transform ----------
+			Mat padded = Mat::zeros(t.dftSize, CV_32FC1), channel, spectrum, sum;
+			for (int c = 0; c < 3; c++) {
+				extractChannel(src, channel, c);
+				channel.convertTo(padded(Rect(0, 0, src.cols, src.rows)), CV_32F);
+				dft(padded, spectrum, 0, src.rows);
+				mulSpectrums(spectrum, t.spectrum[c], spectrum, 0, true);
+				if (c == 0) spectrum.copyTo(sum);
+				else sum += spectrum;
+			}
+			dft(sum, padded, DFT_INVERSE | DFT_SCALE | DFT_REAL_OUTPUT, positions.height);
+
+			// ---------- normalized by the energy of the image under the template (as OpenCV does) ----------
+			Mat sums, sqsums;
+			integral(src, sums, sqsums, CV_64F, CV_64F);
+			result.create(positions, CV_32FC1);
+			for (int y = 0; y < positions.height; y++) {
+				const float* corr = padded.ptr<float>(y);
+				const double* q0 = sqsums.ptr<double>(y);
+				const double* q1 = sqsums.ptr<double>(y + t.image.rows);
+				float* out = result.ptr<float>(y);
+				for (int x = 0; x < positions.width; x++) {
+					int l = x * 3, r = (x + t.image.cols) * 3;
+					double energy = 0;
+					for (int c = 0; c < 3; c++) {
+						energy += q1[r + c] - q1[l + c] - q0[r + c] + q0[l + c];
+					}
+					double num = corr[x], den = sqrt(std::max(energy, 0.0)) * t.norm;
+					if (fabs(num) < den)				num /= den;
+					else if (fabs(num) < den * 1.125)	num = (num > 0) ? 1 : -1;
+					else								num = 0;
+					out[x] = float(num);
+				}
+			}
+		}
+
+		//=========================================================================================
+		~BallTemplateBank (void) {}
+};
+
+}
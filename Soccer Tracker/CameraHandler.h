@@ -8,6 +8,7 @@
 #include "Configurator.h"
 #include "VideoReader.h"
 #include "TemplateGenerator.h"
+#include "ModelRegistry.h"
 
 using namespace cv;
 using namespace std;
@@ -21,6 +22,7 @@ struct Camera {
 
 	Point3d camCoords;
 	int id, idx;
+	string videoName;
 	bool viewHFlip, viewVFlip, projHFlip, projVFlip;
 	//Point crd, videoResolution;
 	Mat homography;
@@ -28,9 +30,10 @@ struct Camera {
 	Rect viewRect;
 	Scalar backGrColor;
 	vector<Mat> ballTemplates;
+	const BallTemplateBank* ballBank; // the same templates with their statistics, owned by the registry
 	int hueIntervalL, hueIntervalR;
 	double perspectiveRatio;
-	Camera () {}
+	Camera () : ballBank(NULL) {}
 };
 
 //*************************************************************************************************
@@ -44,6 +47,7 @@ class CameraHandler {
 		Configurator* configurator;
 		VideoReader* vidReader;
 		vector<Camera*> cameras;
+		string videoFolder; // when set, videos are <videoFolder><idx>.avi instead of the configured ones
 
 	//_____________________________________________________________________________________________
 	public:
@@ -63,8 +67,9 @@ class CameraHandler {
 			cam->projHFlip = configurator->readObject<bool>("projHFlip"+to_string(idx));
 			cam->projVFlip = configurator->readObject<bool>("projVFlip"+to_string(idx));
 
-			string videoName = configurator->readObject<string>("video" + to_string(idx));
+			string videoName = videoFolder.empty() ? configurator->readObject<string>("video" + to_string(idx)) : videoFolder + to_string(idx) + ".avi";
 			cam->capture = vidReader->addVideo(videoName);
+			cam->videoName = videoName;
 
 			int vidW = int(cam->capture.get(CV_CAP_PROP_FRAME_WIDTH));
 			int vidH = int(cam->capture.get(CV_CAP_PROP_FRAME_HEIGHT));
@@ -78,10 +83,11 @@ class CameraHandler {
 
 			vector<int> ballTemplRadiusRange = configurator->readObject<vector<int>>("templRad" + to_string(idx));
 
-			// Creates ball templates
-			vector<Mat> templates = TemplateGenerator::createBallTemplVctr ( ballTemplRadiusRange[0], ballTemplRadiusRange[1], 1, cam->backGrColor );
+			// Creates ball templates (once for all cameras with the same ones), radiuses from the range [min, max) in steps
+			double ballTemplStep = configurator->readObject<double>("templRadStep");
+			cam->ballBank = &ModelRegistry::instance().getBallBank( ballTemplRadiusRange[0], ballTemplRadiusRange[1] - 1, ballTemplStep, cam->backGrColor );
 			//reverse(templates.begin(), templates.end());
-			cam->ballTemplates = templates;
+			cam->ballTemplates = cam->ballBank->getImages();
 
 			vector<int> hueIntervals = configurator->readObject<vector<int>>("hue" + to_string(idx));
 			cam->hueIntervalL = hueIntervals[0];
@@ -96,6 +102,11 @@ class CameraHandler {
 			CAMERAS_CNT = cameras.size();
 		}
 
+		//=========================================================================================
+		void setVideoFolder (string folder) {
+			videoFolder = folder;
+		}
+
 		//=========================================================================================
 		void updateFSize () {
 			int vidW = (int) cameras[0]->capture.get(CV_CAP_PROP_FRAME_WIDTH);
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+
+#include "CameraHandler.h"
+#include "FramePrefetcher.h"
+#include "BackGroundRemover.h"
+#include "FieldRegion.h"
+#include "PerspectiveModel.h"
+#include "ContourAnalyzer.h"
+#include "Tracker.h"
+#include "TrackInfo.h"
+#include "TaskPool.h"
+#include "StageProfiler.h"
+#include "globalSettings.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- All the per-camera state of the tracking: frame source, background removal, contour
+// ----- analysis and tracker. Every stage is a method that is run as a task on the TaskPool,
+// ----- stages of one camera are never run concurrently
+//*************************************************************************************************
+class CameraPipeline {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		int TID;
+		Camera* camera;
+		int processedFrames, trackedFrames;
+		bool frameReady;
+		Rect camViewRect;
+
+		FramePrefetcher prefetcher;
+		BackGroundRemover remover;
+		ContourAnalyzer cAnalyzer;
+		Tracker tracker;
+		ofstream* outFile;
+
+		// ----- background model kept on disk between runs, written by a pool task -----
+		TaskPool* pool;
+		string modelFile, modelKey;
+		int modelSaveInterval;
+		mutex saveMtx;
+		condition_variable saveCV;
+		bool modelSaving;
+		#ifdef WRITE_VIDEO
+		cv::VideoWriter vidWriter;
+		#endif
+
+		// ----- current frame and results of its segmentation -----
+		Mat frame, playerMask;
+		vector<Rect> players_cand;
+		vector<Point> ball_cand;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		CameraPipeline (int TID, Camera* camera, int prefetchDepth, int skipFrames, vector<Point>& givenTrajectory, ofstream& outFile, TaskPool* pool) :
+			prefetcher(TID, camera->capture, Size(fSize), camera->viewHFlip, prefetchDepth, skipFrames),
+			remover(500, 256, 5, false) {
+
+			this->TID = TID;
+			this->camera = camera;
+			this->outFile = &outFile;
+			camViewRect = camera->viewRect;
+			processedFrames = skipFrames;
+			trackedFrames = 0;
+			frameReady = false;
+			modelSaveInterval = 0;
+			modelSaving = false;
+			this->pool = pool;
+
+			tracker.initialize(TID);
+			if (camera->ballBank != NULL) {
+				tracker.setBallBank(*camera->ballBank);
+			} else {
+				tracker.setBallTempls(camera->ballTemplates);
+			}
+
+			// ----- the configured ratio, or the one the homography and the camera position give -----
+			double ratio = (camera->perspectiveRatio > 0) ? camera->perspectiveRatio : PerspectiveModel::ratioFromHomography(camera, Size(fSize));
+			PerspectiveModel perspective(ratio, fSize.y);
+			tracker.setPerspective(perspective);
+			cAnalyzer.setPerspective(perspective);
+			tracker.setGivenTrajectory(givenTrajectory);
+			tracker.setTaskPool(pool);
+
+			prefetcher.start();
+		}
+
+		#ifdef WRITE_VIDEO
+		//=========================================================================================
+		void setVideoWriter (cv::VideoWriter vidWriter) {
+			this->vidWriter = vidWriter;
+		}
+		#endif
+
+		//=========================================================================================
+		double setFieldRegion (double margin, double headroom) {
+			// ---------- only the pitch (from the homography) is segmented, returns its share of the frame ----------
+			FieldRegion region(camera, Size(fSize), margin, headroom);
+			if (region.empty()) {
+				return 0.0;
+			}
+			remover.setFieldRegion(region);
+			tracker.setFieldRegion(region.getMask());
+			return region.coverage();
+		}
+
+		//=========================================================================================
+		void setDriftThresholds (double driftDistance, double sceneCutDistance) {
+			remover.setDriftThresholds(driftDistance, sceneCutDistance);
+		}
+
+		//=========================================================================================
+		bool setModelFile (string fileName, string source, int saveInterval) {
+			// ---------- warm start from the saved background, it is saved again every saveInterval frames.
+			// ---------- The model fits only the same source, segmented region and bins (set the region first) ----------
+			modelFile = fileName;
+			modelKey = source + " | region " + remover.getFieldRegion().signature() + " | bins " + to_string(remover.getBins());
+			modelSaveInterval = saveInterval;
+			return remover.loadModel(modelFile, modelKey);
+		}
+
+		//=========================================================================================
+		void saveModelAsync () {
+			// ---------- the snapshot is taken now, the file is written on the pool (skipped while
+			// ---------- the previous one is still being written) ----------
+			{
+				lock_guard<mutex> lock(saveMtx);
+				if (modelSaving) return;
+				modelSaving = true;
+			}
+			BackgroundSnapshot snapshot = remover.getModelSnapshot();
+			auto write = [this, snapshot] {
+				BackGroundRemover::saveModel(modelFile, modelKey, snapshot);
+				lock_guard<mutex> lock(saveMtx);
+				modelSaving = false;
+				saveCV.notify_all();
+			};
+			if (pool != NULL)	pool->submit(write);
+			else				write();
+		}
+
+		//=========================================================================================
+		void saveModel () {
+			// ---------- at the end: after the pending write, the final model ----------
+			if (!modelFile.empty()) {
+				unique_lock<mutex> lock(saveMtx);
+				saveCV.wait(lock, [&] { return !modelSaving; });
+				remover.saveModel(modelFile, modelKey);
+			}
+		}
+
+		//=========================================================================================
+		bool segment () {
+			// ---------- take the next (already resized and flipped) frame and find candidates in it ----------
+			frameReady = prefetcher.read(frame);
+			if (!frameReady) {
+				return false;
+			}
+
+			Mat mask = remover.processFrame(frame, TID);
+			playerMask = mask.clone();
+			if (modelSaveInterval > 0 && processedFrames % modelSaveInterval == 0) {
+				saveModelAsync();
+			}
+
+			players_cand.clear();
+			ball_cand.clear();
+			StageTimer timer(TID, STAGE_CONTOURS);
+			cAnalyzer.process(mask, players_cand, ball_cand, remover.getFieldRegion().getBounds());
+			return true;
+		}
+
+		//=========================================================================================
+		void track (vector<ProjCandidate*> truePositives, TrackInfo& trackInfo) {
+			// ----- IDs of new candidates carry the camera index, the task may run on any worker -----
+			int prevShift = ID_shift;
+			ID_shift = TID;
+
+			tracker.setTrackInfo(trackInfo);
+			tracker.processFrame(frame, ball_cand, players_cand, truePositives, TID, processedFrames, *outFile, playerMask);
+			trackInfo = tracker.getTrackInfo();
+			trackedFrames++;
+			processedFrames++;
+
+			ID_shift = prevShift;
+		}
+
+		//=========================================================================================
+		void render (bool showTraj, Mat& cameraView) {
+			// ---------- display results for single camera ----------
+			StageTimer timer(TID, STAGE_DRAW);
+			if (showTraj)	tracker.getTrajFrame(frame);
+			else			tracker.drawTrackingMarks(frame, TID);
+
+			#ifdef WRITE_VIDEO
+			vidWriter << frame;
+			#endif
+
+			resize(frame, frame, Size(camViewRect.width, camViewRect.height));
+			frame.copyTo(cameraView(camViewRect));
+
+			if (TID == 0)
+			{
+				cameraView(Rect(640 + 210, 0, 200, 100)) = CV_RGB(0, 0, 0);
+				// ----- index of the frame that was tracked last -----
+				putText(cameraView, to_string(processedFrames - 1), Point(640 + 280, 50), FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(255, 255, 255));
+			}
+		}
+
+		//=========================================================================================
+		void addCandidateManually (int x, int y) {
+			int prevShift = ID_shift;
+			ID_shift = TID;
+			tracker.ball_addCandidateManually(x, y);
+			ID_shift = prevShift;
+		}
+
+		//=========================================================================================
+		bool hasFrame () {
+			return frameReady;
+		}
+
+		//=========================================================================================
+		int getTrackedFrames () {
+			return trackedFrames;
+		}
+
+		//=========================================================================================
+		int getProcessedFrames () {
+			return processedFrames;
+		}
+
+		//=========================================================================================
+		void printReport (int staleness) {
+			printf("camera %d processed %d frames\n", TID, processedFrames);
+			printf("camera %d background: mask rebuilt %d times, %d scene cuts\n", TID, remover.getMaskRebuilds(), remover.getSceneCuts());
+			AppearanceAnalyzer& appearance = tracker.getAppearAnalyzer();
+			double frames = std::max(processedFrames, 1);
+			printf("camera %d ball windows: %.1f per frame, %.0f template positions per frame, %.0f correlated\n", TID,
+				appearance.getSearchedWindows() / frames, appearance.getSearchedArea() / frames, appearance.getCorrelation().getComputedArea() / frames);
+			printf("camera %d occlusions: %d groups solved, %d left over budget\n", TID,
+				tracker.getOcclusionSolver().getSolvedGroups(), tracker.getOcclusionSolver().getSkippedGroups());
+			#ifdef COMPACT_TEAM_FEATURE
+			TeamPrototypes& teams = appearance.getTeamPrototypes();
+			if (teams.ready()) {
+				printf("camera %d teams: the compact feature agrees with the classifier on A %.0f %% (%d), B %.0f %% (%d), referee %.0f %% (%d)\n", TID,
+					100 * teams.getAgreement(0), teams.getCompared(0), 100 * teams.getAgreement(1), teams.getCompared(1), 100 * teams.getAgreement(2), teams.getCompared(2));
+			} else {
+				printf("camera %d teams: compact feature not calibrated (samples A %d, B %d, referee %d), the classifier was used\n", TID,
+					teams.getSamples(0), teams.getSamples(1), teams.getSamples(2));
+			}
+			#endif
+			printf("camera %d accuracy (staleness %d): %s\n", TID, staleness, tracker.getMetric().toString_summary().c_str());
+			prefetcher.printReport();
+		}
+
+		//=========================================================================================
+		~CameraPipeline (void) {
+			// ----- a pending write still uses the pipeline -----
+			unique_lock<mutex> lock(saveMtx);
+			saveCV.wait(lock, [&] { return !modelSaving; });
+		}
+};
+
+}
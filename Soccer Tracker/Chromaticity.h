@@ -0,0 +1,290 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv2/core/core.hpp>
+#include <smmintrin.h>
+#include <immintrin.h>
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Chromaticity normalization of BGR frames: every channel c of a pixel becomes
+// ----- 255 * c / (b + g + r) (integer division, a sum of 0 counts as 1).
+// ----- Instead of three divisions per pixel the kernels multiply by k = 255.0f / s, one float
+// ----- division shared by the three channels (a table of k for the scalar kernel):
+// -----   c * k differs from 255 * c / s by less than 255 * 2^-23 < 2^-15, a non-integer quotient
+// -----   is at least 1/s >= 1/765 below the next integer, so trunc(c * k + 2^-12) is exactly
+// -----   the integer quotient for every c <= s <= 765 (checked for all 2^24 colors).
+// ----- SSE4.1 and AVX2 kernels are selected at runtime, cv::setUseOptimized(false) forces the scalar one.
+// ----- green() writes the normalized green channel only (1 byte per pixel), the rest is not stored
+//*************************************************************************************************
+class Chromaticity {
+
+	typedef void (*RowKernel)(const uchar* inp, uchar* outp, int width);
+
+	// ----- the row kernels write all three channels or the green one only -----
+	static const int OUT_ALL = 3, OUT_GREEN = 1;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		//=========================================================================================
+		static const float* reciprocals () {
+			// ----- k = 255 / s for every possible sum of the channels -----
+			struct Table {
+				float k[766];
+				Table () {
+					k[0] = 255.0f;
+					for (int s = 1; s < 766; s++) {
+						k[s] = 255.0f / float(s);
+					}
+				}
+			};
+			static const Table table;
+			return table.k;
+		}
+
+		//=========================================================================================
+		struct ShuffleMasks {
+			// ----- deinterleave[ch][k]: bytes of channel ch found in the k-th 16 bytes of 16 BGR pixels -----
+			// ----- interleave[k][ch]: bytes of channel ch written to the k-th 16 bytes -----
+			// ----- (both 128-bit lanes are the same, AVX2 shuffles bytes within lanes only) -----
+			alignas(32) char deinterleave[3][3][32];
+			alignas(32) char interleave[3][3][32];
+
+			ShuffleMasks () {
+				for (int a = 0; a < 3; a++) {
+					for (int b = 0; b < 3; b++) {
+						for (int j = 0; j < 32; j++) {
+							int p = 3 * (j % 16) + a;		// byte of pixel j, channel a
+							deinterleave[a][b][j] = (p / 16 == b) ? char(p % 16) : char(0x80);
+							int q = 16 * a + (j % 16);		// j-th byte of chunk a
+							interleave[a][b][j] = (q % 3 == b) ? char(q / 3) : char(0x80);
+						}
+					}
+				}
+			}
+		};
+
+		//=========================================================================================
+		static const ShuffleMasks& masks () {
+			static const ShuffleMasks m;
+			return m;
+		}
+
+		//=========================================================================================
+		template <int OUT>
+		static void normalizeRow_scalar (const uchar* inp, uchar* outp, int width) {
+			const float* k = reciprocals();
+			for (int j = 0; j < width; j++) {
+				int b = inp[0], g = inp[1], r = inp[2];
+				float kj = k[b + g + r];
+				if (OUT == OUT_ALL) {
+					outp[0] = uchar(int(b * kj + 0.000244140625f));
+					outp[1] = uchar(int(g * kj + 0.000244140625f));
+					outp[2] = uchar(int(r * kj + 0.000244140625f));
+				} else {
+					outp[0] = uchar(int(g * kj + 0.000244140625f));
+				}
+				inp += 3;
+				outp += OUT;
+			}
+		}
+
+		//=========================================================================================
+		template <int OUT>
+		static void normalizeRow_SSE41 (const uchar* inp, uchar* outp, int width) {
+			// ---------- 16 pixels per iteration ----------
+			const ShuffleMasks& m = masks();
+			const __m128 k255 = _mm_set1_ps(255.0f), eps = _mm_set1_ps(0.000244140625f);
+			const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+
+			__m128i dMask[3][3], iMask[3][3];
+			for (int a = 0; a < 3; a++) {
+				for (int b = 0; b < 3; b++) {
+					dMask[a][b] = _mm_load_si128((const __m128i*)m.deinterleave[a][b]);
+					iMask[a][b] = _mm_load_si128((const __m128i*)m.interleave[a][b]);
+				}
+			}
+
+			int j = 0;
+			for (; j + 16 <= width; j += 16, inp += 48, outp += 16 * OUT) {
+				__m128i in[3] = {
+					_mm_loadu_si128((const __m128i*)inp),
+					_mm_loadu_si128((const __m128i*)(inp + 16)),
+					_mm_loadu_si128((const __m128i*)(inp + 32))
+				};
+
+				__m128i c[3], lo[3], hi[3];
+				for (int ch = 0; ch < 3; ch++) {
+					c[ch] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in[0], dMask[ch][0]),
+						_mm_shuffle_epi8(in[1], dMask[ch][1])), _mm_shuffle_epi8(in[2], dMask[ch][2]));
+					lo[ch] = _mm_unpacklo_epi8(c[ch], zero);
+					hi[ch] = _mm_unpackhi_epi8(c[ch], zero);
+				}
+				__m128i sLo = _mm_max_epi16(_mm_add_epi16(_mm_add_epi16(lo[0], lo[1]), lo[2]), one);
+				__m128i sHi = _mm_max_epi16(_mm_add_epi16(_mm_add_epi16(hi[0], hi[1]), hi[2]), one);
+
+				// ----- 255 / s of the 16 pixels in 4 vectors -----
+				__m128 k[4] = {
+					_mm_div_ps(k255, _mm_cvtepi32_ps(_mm_unpacklo_epi16(sLo, zero))),
+					_mm_div_ps(k255, _mm_cvtepi32_ps(_mm_unpackhi_epi16(sLo, zero))),
+					_mm_div_ps(k255, _mm_cvtepi32_ps(_mm_unpacklo_epi16(sHi, zero))),
+					_mm_div_ps(k255, _mm_cvtepi32_ps(_mm_unpackhi_epi16(sHi, zero)))
+				};
+
+				for (int ch = (OUT == OUT_ALL ? 0 : 1); ch < (OUT == OUT_ALL ? 3 : 2); ch++) {
+					__m128i v[4] = { _mm_unpacklo_epi16(lo[ch], zero), _mm_unpackhi_epi16(lo[ch], zero),
+									 _mm_unpacklo_epi16(hi[ch], zero), _mm_unpackhi_epi16(hi[ch], zero) };
+					__m128i q[4];
+					for (int i = 0; i < 4; i++) {
+						q[i] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v[i]), k[i]), eps));
+					}
+					c[ch] = _mm_packus_epi16(_mm_packus_epi32(q[0], q[1]), _mm_packus_epi32(q[2], q[3]));
+				}
+
+				if (OUT == OUT_GREEN) {
+					_mm_storeu_si128((__m128i*)outp, c[1]);
+					continue;
+				}
+				for (int t = 0; t < 3; t++) {
+					__m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(c[0], iMask[t][0]),
+						_mm_shuffle_epi8(c[1], iMask[t][1])), _mm_shuffle_epi8(c[2], iMask[t][2]));
+					_mm_storeu_si128((__m128i*)(outp + 16 * t), out);
+				}
+			}
+			normalizeRow_scalar<OUT>(inp, outp, width - j);
+		}
+
+		//=========================================================================================
+		template <int OUT>
+		static void normalizeRow_AVX2 (const uchar* inp, uchar* outp, int width) {
+			// ---------- 32 pixels per iteration: the lanes hold pixels 0..15 and 16..31 ----------
+			const ShuffleMasks& m = masks();
+			const __m256 k255 = _mm256_set1_ps(255.0f), eps = _mm256_set1_ps(0.000244140625f);
+			const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi16(1);
+
+			__m256i dMask[3][3], iMask[3][3];
+			for (int a = 0; a < 3; a++) {
+				for (int b = 0; b < 3; b++) {
+					dMask[a][b] = _mm256_load_si256((const __m256i*)m.deinterleave[a][b]);
+					iMask[a][b] = _mm256_load_si256((const __m256i*)m.interleave[a][b]);
+				}
+			}
+
+			int j = 0;
+			for (; j + 32 <= width; j += 32, inp += 96, outp += 32 * OUT) {
+				__m256i l0 = _mm256_loadu_si256((const __m256i*)inp);
+				__m256i l1 = _mm256_loadu_si256((const __m256i*)(inp + 32));
+				__m256i l2 = _mm256_loadu_si256((const __m256i*)(inp + 64));
+				// ----- lane 0 gets bytes 16k..16k+15 of the first 16 pixels, lane 1 those of the next 16 -----
+				__m256i in[3] = {
+					_mm256_permute2x128_si256(l0, l1, 0x30),
+					_mm256_permute2x128_si256(l0, l2, 0x21),
+					_mm256_permute2x128_si256(l1, l2, 0x30)
+				};
+
+				__m256i c[3], lo[3], hi[3];
+				for (int ch = 0; ch < 3; ch++) {
+					c[ch] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(in[0], dMask[ch][0]),
+						_mm256_shuffle_epi8(in[1], dMask[ch][1])), _mm256_shuffle_epi8(in[2], dMask[ch][2]));
+					lo[ch] = _mm256_unpacklo_epi8(c[ch], zero);
+					hi[ch] = _mm256_unpackhi_epi8(c[ch], zero);
+				}
+				__m256i sLo = _mm256_max_epi16(_mm256_add_epi16(_mm256_add_epi16(lo[0], lo[1]), lo[2]), one);
+				__m256i sHi = _mm256_max_epi16(_mm256_add_epi16(_mm256_add_epi16(hi[0], hi[1]), hi[2]), one);
+
+				__m256 k[4] = {
+					_mm256_div_ps(k255, _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(sLo, zero))),
+					_mm256_div_ps(k255, _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(sLo, zero))),
+					_mm256_div_ps(k255, _mm256_cvtepi32_ps(_mm256_unpacklo_epi16(sHi, zero))),
+					_mm256_div_ps(k255, _mm256_cvtepi32_ps(_mm256_unpackhi_epi16(sHi, zero)))
+				};
+
+				// ----- unpacking and packing both work within lanes, so the pixels stay in order -----
+				for (int ch = (OUT == OUT_ALL ? 0 : 1); ch < (OUT == OUT_ALL ? 3 : 2); ch++) {
+					__m256i v[4] = { _mm256_unpacklo_epi16(lo[ch], zero), _mm256_unpackhi_epi16(lo[ch], zero),
+									 _mm256_unpacklo_epi16(hi[ch], zero), _mm256_unpackhi_epi16(hi[ch], zero) };
+					__m256i q[4];
+					for (int i = 0; i < 4; i++) {
+						q[i] = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(v[i]), k[i]), eps));
+					}
+					c[ch] = _mm256_packus_epi16(_mm256_packus_epi32(q[0], q[1]), _mm256_packus_epi32(q[2], q[3]));
+				}
+
+				if (OUT == OUT_GREEN) {
+					_mm256_storeu_si256((__m256i*)outp, c[1]);
+					continue;
+				}
+				__m256i out[3];
+				for (int t = 0; t < 3; t++) {
+					out[t] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(c[0], iMask[t][0]),
+						_mm256_shuffle_epi8(c[1], iMask[t][1])), _mm256_shuffle_epi8(c[2], iMask[t][2]));
+				}
+				_mm256_storeu_si256((__m256i*)outp, _mm256_permute2x128_si256(out[0], out[1], 0x20));
+				_mm256_storeu_si256((__m256i*)(outp + 32), _mm256_permute2x128_si256(out[2], out[0], 0x30));
+				_mm256_storeu_si256((__m256i*)(outp + 64), _mm256_permute2x128_si256(out[1], out[2], 0x31));
+			}
+			_mm256_zeroupper();
+			normalizeRow_scalar<OUT>(inp, outp, width - j);
+		}
+
+		//=========================================================================================
+		template <int OUT>
+		static RowKernel selectKernel () {
+			if (!useOptimized())						return normalizeRow_scalar<OUT>;
+			if (checkHardwareSupport(CV_CPU_AVX2))		return normalizeRow_AVX2<OUT>;
+			if (checkHardwareSupport(CV_CPU_SSE4_1))	return normalizeRow_SSE41<OUT>;
+			return normalizeRow_scalar<OUT>;
+		}
+
+		//=========================================================================================
+		static void run (RowKernel kernel, Mat& input, Mat& output) {
+			int fH = input.rows;
+			int fW = input.cols;
+
+			if (input.isContinuous() && output.isContinuous()) {
+				fW = fW * fH;
+				fH = 1;
+			}
+
+			for (int i = 0; i < fH; i++) {
+				kernel(input.ptr<uchar>(i), output.ptr<uchar>(i), fW);
+			}
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		static void normalize (Mat& input, Mat& output) {
+			// ---------- input and output are CV_8UC3 of the same size ----------
+			run(selectKernel<OUT_ALL>(), input, output);
+		}
+
+		//=========================================================================================
+		static void green (Mat& input, Mat& output) {
+			// ---------- input is CV_8UC3, output CV_8UC1 of the same size ----------
+			output.create(input.size(), CV_8UC1);
+			run(selectKernel<OUT_GREEN>(), input, output);
+		}
+
+		//=========================================================================================
+		static void green (const uchar* inp, uchar* outp, int width) {
+			// ---------- one span of a row: width BGR pixels in, width bytes out ----------
+			selectKernel<OUT_GREEN>()(inp, outp, width);
+		}
+
+		//=========================================================================================
+		static const char* kernelName () {
+			RowKernel kernel = selectKernel<OUT_ALL>();
+			if (kernel == normalizeRow_AVX2<OUT_ALL>)	return "AVX2";
+			if (kernel == normalizeRow_SSE41<OUT_ALL>)	return "SSE4.1";
+			return "scalar";
+		}
+};
+
+}
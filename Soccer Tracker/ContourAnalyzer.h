@@ -1,6 +1,7 @@
 #pragma once
 
 #include "globalSettings.h"
+#include "PerspectiveModel.h"
 
 #include <opencv/cv.h>
 #include <vector>
@@ -25,6 +26,163 @@ class ContourAnalyzer {
 
 		double expectedBallSize[2], expectedPlayerSize[2];
 
+		// ----- the size gates on every row (sizes above are the ones on the bottom row) -----
+		vector<int> playerMinH, playerMaxH, ballMinH, ballMaxH;
+
+		// ----- statistics of one 8-connected blob of the mask -----
+		struct BlobStats {
+			int minX, minY, maxX, maxY;
+			int seedX;				// its first pixel is (seedX, minY)
+			int pixels, contour;	// all its pixels, points of its contours (a pixel once per pass)
+			int quads;				// 4 x Euler number (1 - holes), from the 2x2 quads it covers
+		};
+
+		// ----- union-find of the provisional labels, their statistics, labels of the last two rows -----
+		vector<int> parent;
+		vector<BlobStats> blobs;
+		vector<int> rowLabels[2];
+
+		//=========================================================================================
+		static const uchar* contourPasses () {
+			// ----- times the contours of the blob pass through a pixel, for each of its 8-neighbourhoods
+			// ----- (bit i: neighbour i clockwise from the top-left one): one per run of background
+			// ----- neighbours that holds a 4-neighbour, a pixel alone is one contour point -----
+			struct Table {
+				uchar passes[256];
+				Table () {
+					for (int code = 0; code < 256; code++) {
+						int runs = 0;
+						for (int i = 0; i < 8; i++) {
+							bool start = !((code >> i) & 1) && ((code >> ((i + 7) % 8)) & 1);
+							if (!start) continue;
+							bool has4 = false;
+							for (int j = i; !((code >> (j % 8)) & 1); j++) {
+								if (j % 2 == 1) has4 = true;
+							}
+							if (has4) runs++;
+						}
+						passes[code] = uchar((code == 0) ? 1 : runs);
+					}
+				}
+			};
+			static const Table table;
+			return table.passes;
+		}
+
+		//=========================================================================================
+		void addQuad (int a, int b, int c, int d) {
+			// ----- labels of a 2x2 quad (a b / c d, -1 background): its pixels are 8-neighbours, so they
+			// ----- belong to one blob. Euler number (8-connectivity) = (Q1 - Q3 - 2 QD) / 4 -----
+			int n = (a >= 0) + (b >= 0) + (c >= 0) + (d >= 0);
+			if (n == 0 || n == 4) return;
+			int label = (a >= 0) ? a : (b >= 0) ? b : (c >= 0) ? c : d;
+			if (n == 1)							blobs[label].quads++;
+			else if (n == 3)					blobs[label].quads--;
+			else if ((a >= 0) == (d >= 0))		blobs[label].quads -= 2;
+		}
+
+		//=========================================================================================
+		int findRoot (int label) {
+			while (parent[label] != label) {
+				parent[label] = parent[parent[label]];
+				label = parent[label];
+			}
+			return label;
+		}
+
+		//=========================================================================================
+		int join (int label, int neighbour) {
+			// ----- the smaller label becomes the root, so roots are in raster order -----
+			if (neighbour < 0) return label;
+			neighbour = findRoot(neighbour);
+			if (label < 0 || label == neighbour) return neighbour;
+			if (label < neighbour) {
+				parent[neighbour] = label;
+				return label;
+			}
+			parent[label] = neighbour;
+			return neighbour;
+		}
+
+		//=========================================================================================
+		void extractBlobs (const Mat& binMask, Rect roi) {
+			// ---------- one raster pass: provisional labels from the W, NW, N and NE neighbours,
+			// ---------- the statistics are added to the label the pixel got. Pixels outside roi are background ----------
+			parent.clear();
+			blobs.clear();
+			int W = roi.width;
+			rowLabels[0].assign(W + 2, -1);
+			rowLabels[1].assign(W + 2, -1);
+			const uchar* passes = contourPasses();
+
+			for (int y = roi.y; y < roi.y + roi.height; y++) {
+				int* cur = &rowLabels[(y - roi.y) & 1][1];
+				int* prev = &rowLabels[(y - roi.y + 1) & 1][1];
+				const uchar* m = binMask.ptr<uchar>(y) + roi.x;
+				const uchar* up = (y > roi.y) ? binMask.ptr<uchar>(y - 1) + roi.x : NULL;
+				const uchar* down = (y + 1 < roi.y + roi.height) ? binMask.ptr<uchar>(y + 1) + roi.x : NULL;
+
+				for (int x = 0; x < W; x++) {
+					if (m[x] == 0) {
+						cur[x] = -1;
+						addQuad(prev[x - 1], prev[x], cur[x - 1], cur[x]);
+						continue;
+					}
+					int label = join(join(join(join(-1, cur[x - 1]), prev[x - 1]), prev[x]), prev[x + 1]);
+					if (label < 0) {
+						label = int(parent.size());
+						parent.push_back(label);
+						BlobStats blob = { x, y, x, y, x, 0, 0, 0 };
+						blobs.push_back(blob);
+					}
+					cur[x] = label;
+					addQuad(prev[x - 1], prev[x], cur[x - 1], cur[x]);
+
+					BlobStats& blob = blobs[label];
+					blob.minX = std::min(blob.minX, x);
+					blob.maxX = std::max(blob.maxX, x);
+					blob.maxY = y;
+					blob.pixels++;
+
+					// ----- the 8-neighbourhood clockwise from the top-left, outside roi is background -----
+					bool l = (x > 0), r = (x + 1 < W);
+					int code =	((up != NULL && l && up[x - 1])		? 1 : 0)	| ((up != NULL && up[x])			? 2 : 0)	|
+								((up != NULL && r && up[x + 1])		? 4 : 0)	| ((r && m[x + 1])					? 8 : 0)	|
+								((down != NULL && r && down[x + 1])	? 16 : 0)	| ((down != NULL && down[x])		? 32 : 0)	|
+								((down != NULL && l && down[x - 1])	? 64 : 0)	| ((l && m[x - 1])					? 128 : 0);
+					blob.contour += passes[code];
+				}
+				cur[W] = -1;
+				addQuad(prev[W - 1], prev[W], cur[W - 1], cur[W]);
+			}
+
+			// ----- the quads below the last row -----
+			const int* last = &rowLabels[(roi.height - 1) & 1][1];
+			for (int x = 0; x <= W; x++) {
+				addQuad(last[x - 1], last[x], -1, -1);
+			}
+
+			// ---------- statistics of every label go to the root of its blob ----------
+			for (int label = 0; label < int(parent.size()); label++) {
+				int root = findRoot(label);
+				if (root == label) continue;
+				BlobStats& r = blobs[root];
+				BlobStats& b = blobs[label];
+				r.minX = std::min(r.minX, b.minX);
+				r.maxX = std::max(r.maxX, b.maxX);
+				r.minY = std::min(r.minY, b.minY);
+				r.maxY = std::max(r.maxY, b.maxY);
+				r.pixels += b.pixels;
+				r.contour += b.contour;
+				r.quads += b.quads;
+			}
+			for (auto& blob : blobs) {
+				blob.minX += roi.x;
+				blob.maxX += roi.x;
+				blob.seedX += roi.x;
+			}
+		}
+
 	//_____________________________________________________________________________________________
 	public:
 
@@ -37,9 +195,109 @@ class ContourAnalyzer {
 		}
 
 		//=========================================================================================
-		void process (const Mat& binMask, vector<Rect>& players, vector<Point>& ball) {
+		void setPerspective (PerspectiveModel& perspective) {
+			// ---------- the gates shrink with the distance, far away small noise and big blobs are dropped ----------
+			int rows = perspective.getRows();
+			playerMinH.resize(rows);
+			playerMaxH.resize(rows);
+			ballMinH.resize(rows);
+			ballMaxH.resize(rows);
+			for (int y = 0; y < rows; y++) {
+				double s = perspective.getScale(y);
+				playerMinH[y] = int(expectedPlayerSize[0] * fSize.y * s);
+				playerMaxH[y] = int(expectedPlayerSize[1] * fSize.x * s);
+				ballMinH[y] = int(expectedBallSize[0] * fSize.y * s);
+				ballMaxH[y] = int(expectedBallSize[1] * fSize.x * s);
+			}
+		}
+
+		//=========================================================================================
+		void process (const Mat& binMask, vector<Rect>& players, vector<Point>& ball, Rect roi = Rect()) {
+			// ---------- candidates from the statistics of the connected components, in one pass over the mask,
+			// ---------- with the perimeter (points of the outer contour) and area (contourArea) findContours gives:
+			// ---------- - a blob without holes: its contour passes through a pixel once per run of background
+			// ----------   around it (twice along one-pixel-wide limbs), their sum is the number of points and the
+			// ----------   area is pixels - points / 2 - 1 (Pick's theorem, spikes of limbs have no area)
+			// ---------- - a blob with holes (Euler number below 1, rare) is traced by findContours in its rectangle
+			// ---------- - a blob inside the hole of another one is dropped, as the external contours skip it ----------
+			if (roi.area() <= 0) roi = Rect(0, 0, binMask.cols, binMask.rows);
+			if (int(playerMinH.size()) != binMask.rows) {
+				// ----- no perspective: the same gates everywhere -----
+				PerspectiveModel flat(1.0, binMask.rows);
+				setPerspective(flat);
+			}
+			extractBlobs(binMask, roi);
+
+			// ----- outer contours of the blobs with holes -----
+			struct Holed { int label; Rect rect; vector<Point> contour; };
+			vector<Holed> holed;
+			for (int label = 0; label < int(parent.size()); label++) {
+				BlobStats& blob = blobs[label];
+				if (parent[label] != label || blob.quads >= 4) continue;
+				Rect boundRect(blob.minX, blob.minY, blob.maxX - blob.minX + 1, blob.maxY - blob.minY + 1);
+				vector<vector<Point>> contours;
+				findContours(binMask(boundRect), contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE, boundRect.tl());
+				// ----- pieces of other blobs can be in the rectangle: the one that spans it all, the largest -----
+				int best = -1;
+				double bestArea = -1;
+				for (int i = 0; i < int(contours.size()); i++) {
+					double a = contourArea(contours[i]);
+					if (boundingRect(contours[i]) == boundRect && a > bestArea) {
+						best = i;
+						bestArea = a;
+					}
+				}
+				if (best >= 0) {
+					Holed h = { label, boundRect, contours[best] };
+					holed.push_back(h);
+				}
+			}
+
+			for (int label = 0; label < int(parent.size()); label++) {
+				if (parent[label] != label) continue;
+				BlobStats& blob = blobs[label];
+				Rect boundRect(blob.minX, blob.minY, blob.maxX - blob.minX + 1, blob.maxY - blob.minY + 1);
+
+				double area = std::max(blob.pixels - 0.5 * blob.contour - 1.0, 0.0), perimeter = blob.contour;
+				bool nested = false;
+				for (auto& h : holed) {
+					if (h.label == label) {
+						area = contourArea(h.contour);
+						perimeter = double(h.contour.size());
+					} else if ((h.rect & boundRect) == boundRect && pointPolygonTest(h.contour, Point2f(float(blob.seedX), float(blob.minY)), false) > 0) {
+						nested = true;
+					}
+				}
+				if (nested) continue;
+				double roundness = 4 * PI * area / (perimeter * perimeter);
+				int feet = blob.maxY, center = boundRect.y + boundRect.height / 2;
+
+				// Condition for player (its size is the one where it stands)
+				if ((boundRect.height > playerMinH[feet]) && (boundRect.height < playerMaxH[feet]) &&
+					(boundRect.height > boundRect.width) && (area > 0.3 * double(boundRect.area()))		) 
+				{
+					players.push_back(boundRect);
+				} 
+
+				// Condition for ball
+				else if ((boundRect.height > ballMinH[center]) && (boundRect.height < ballMaxH[center]) &&
+						 (boundRect.height < 2 * boundRect.width) && (boundRect.width < 3 * boundRect.height) &&
+						 (area > 0.2 * double(boundRect.area())) && (roundness > 0.4)) 
+				{
+					ball.push_back(Point(boundRect.x + boundRect.width/2, boundRect.y + boundRect.height/2));
+				}
+			}
+		}
+
+		//=========================================================================================
+		void processContours (const Mat& binMask, vector<Rect>& players, vector<Point>& ball, Rect roi = Rect()) {
+			// ----- the same with findContours (kept for comparison), only roi is searched -----
 			vector<vector<Point>> contours;
-			findContours(binMask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
+			if (roi.area() > 0) {
+				findContours(binMask(roi), contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE, roi.tl());
+			} else {
+				findContours(binMask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
+			}
 			//findContours(image, contours, CV_RETR_LIST, CV_CHAIN_APPROX_NONE);
 
 			vector<vector<Point>> players_cand, ball_cand;
@@ -80,12 +338,8 @@ class ContourAnalyzer {
 
 				// Compute perimeter
 				int perimeter = int(it->size());
-				double perimeter_ = arcLength(*it, true); 
 
 				// Compute roundness
-				Point2f circleCntr;
-				float circleRad;
-				minEnclosingCircle(*it, circleCntr, circleRad);
 				double roundness = 4 * PI * area / (perimeter * perimeter);
 
 				// Condition for player
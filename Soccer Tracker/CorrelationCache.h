@@ -0,0 +1,191 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "BallTemplateBank.h"
+#include "SmallTemplateMatcher.h"
+#include "globalSettings.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Correlation of the ball templates with the whole frame, computed lazily and shared by all
+// ----- ball candidates of the frame. The map of every template is split into tiles of TILE x TILE
+// ----- template positions; a window asks for the positions it covers and only the tiles nobody
+// ----- asked for yet in this frame are matched. Overlapping windows reuse each other's tiles, so
+// ----- the work follows the area covered by the windows, not their number (the restricted area
+// ----- is applied by the peak search). Candidates can ask from several threads at once:
+// ----- a tile is computed by the first thread that claims it, the others wait for it. The tiles
+// ----- are matched by the selected backend: matchTemplate, the precomputed template spectra of a
+// ----- template bank or the small-template kernel (each falls back to matchTemplate if it can't)
+//*************************************************************************************************
+class CorrelationCache {
+
+	//_____________________________________________________________________________________________
+	public:
+
+		static const int TILE = 32;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		struct TemplMap {
+			Mat templ;
+			SmallTemplateMatcher matcher;
+			Mat map;							// CV_32FC1, value of the template placed with its corner at (x, y)
+			int tilesX, tilesY;
+			unique_ptr<atomic<int>[]> state;	// stamp of the frame the tile holds, -stamp while it is computed
+		};
+
+		vector<TemplMap> maps;
+		const BallTemplateBank* bank;	// the same templates with their statistics, or NULL
+		Mat frame;
+		int method;
+		MATCH_BACKEND backend;
+		int stamp;
+
+		atomic<long long> requestedArea, computedArea;
+
+		//=========================================================================================
+		void allocate () {
+			for (auto& m : maps) {
+				int posW = std::max(frame.cols - m.templ.cols + 1, 0);
+				int posH = std::max(frame.rows - m.templ.rows + 1, 0);
+				m.map.create(std::max(posH, 1), std::max(posW, 1), CV_32FC1);
+				m.tilesX = (posW + TILE - 1) / TILE;
+				m.tilesY = (posH + TILE - 1) / TILE;
+				m.state.reset(new atomic<int>[std::max(m.tilesX * m.tilesY, 1)]);
+				for (int i = 0; i < m.tilesX * m.tilesY; i++) m.state[i] = 0;
+			}
+		}
+
+		//=========================================================================================
+		void computeTile (TemplMap& m, int tx, int ty) {
+			Rect positions(tx * TILE, ty * TILE, TILE, TILE);
+			positions &= Rect(0, 0, frame.cols - m.templ.cols + 1, frame.rows - m.templ.rows + 1);
+
+			// ---------- the pixels under all template positions of the tile ----------
+			Mat src = frame(Rect(positions.x, positions.y, positions.width + m.templ.cols - 1, positions.height + m.templ.rows - 1));
+			Mat dst = m.map(positions);
+			match(int(&m - &maps[0]), src, dst);
+			computedArea += positions.area();
+		}
+
+		//=========================================================================================
+		void ensureTile (TemplMap& m, int tx, int ty) {
+			atomic<int>& s = m.state[ty * m.tilesX + tx];
+			int cur = s.load(memory_order_acquire);
+			while (cur != stamp) {
+				if (cur == -stamp) {
+					this_thread::yield();
+					cur = s.load(memory_order_acquire);
+				} else if (s.compare_exchange_weak(cur, -stamp, memory_order_acq_rel)) {
+					computeTile(m, tx, ty);
+					s.store(stamp, memory_order_release);
+					return;
+				}
+			}
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		CorrelationCache (int method = CV_TM_CCORR_NORMED) : bank(NULL), method(method), stamp(0), requestedArea(0), computedArea(0) {
+#ifdef SMALL_TEMPLATE_KERNEL
+			backend = MATCH_SMALL_KERNEL;
+#else
+			backend = MATCH_TEMPLATE_BANK;
+#endif
+		}
+
+		//=========================================================================================
+		void setTemplates (const vector<Mat>& templs, const BallTemplateBank* bank = NULL) {
+			this->bank = bank;
+			maps.clear();
+			maps.resize(templs.size());
+			for (size_t i = 0; i < templs.size(); i++) {
+				maps[i].templ = templs[i];
+				maps[i].matcher = SmallTemplateMatcher(templs[i]);
+			}
+			if (!frame.empty()) allocate();
+			stamp++;
+		}
+
+		//=========================================================================================
+		void setBackend (MATCH_BACKEND backend) {
+			// ----- the tiles of the frame are matched again -----
+			this->backend = backend;
+			stamp++;
+		}
+
+		//=========================================================================================
+		MATCH_BACKEND getBackend () {
+			return backend;
+		}
+
+		//=========================================================================================
+		void match (int templIdx, const Mat& src, Mat& result) {
+			// ---------- all positions of the template in src, by the backend (not cached) ----------
+			TemplMap& m = maps[templIdx];
+			if (method == CV_TM_CCORR_NORMED && backend == MATCH_SMALL_KERNEL && SmallTemplateMatcher::supports(m.templ)) {
+				m.matcher.match(src, result);
+			} else if (method == CV_TM_CCORR_NORMED && backend == MATCH_TEMPLATE_BANK && bank != NULL) {
+				bank->match(src, templIdx, result);
+			} else {
+				matchTemplate(src, m.templ, result, method);
+			}
+		}
+
+		//=========================================================================================
+		void setFrame (const Mat& frame) {
+			// ---------- a new frame: every tile is stale ----------
+			bool resized = frame.size() != this->frame.size();
+			this->frame = frame;
+			if (resized) allocate();
+			stamp++;
+		}
+
+		//=========================================================================================
+		Mat getMap (int templIdx, Rect positions) {
+			// ---------- correlation of the template at the given corner positions (a view of the map,
+			// ---------- valid until the next frame). Positions outside the frame are dropped ----------
+			TemplMap& m = maps[templIdx];
+			positions &= Rect(0, 0, frame.cols - m.templ.cols + 1, frame.rows - m.templ.rows + 1);
+			if (positions.area() <= 0) return Mat();
+
+			int tx0 = positions.x / TILE, tx1 = (positions.br().x - 1) / TILE;
+			int ty0 = positions.y / TILE, ty1 = (positions.br().y - 1) / TILE;
+			for (int ty = ty0; ty <= ty1; ty++) {
+				for (int tx = tx0; tx <= tx1; tx++) {
+					ensureTile(m, tx, ty);
+				}
+			}
+			requestedArea += positions.area();
+			return m.map(positions);
+		}
+
+		//=========================================================================================
+		long long getRequestedArea () {
+			return requestedArea;
+		}
+
+		//=========================================================================================
+		long long getComputedArea () {
+			return computedArea;
+		}
+
+		//=========================================================================================
+		~CorrelationCache (void) {}
+};
+
+}
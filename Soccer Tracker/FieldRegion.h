@@ -0,0 +1,210 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+
+#include "CameraHandler.h"
+#include "globalSettings.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- The part of the frame of one camera where the pitch (and whatever stands on it) is seen.
+// ----- The pitch (105 x 68 m, enlarged by a margin) is lifted by a headroom, both rectangles are
+// ----- projected on the ground through the camera position, and their convex hull is mapped to
+// ----- the frame through the inverse homography. The region is convex, so every row of the
+// ----- frame holds one span of it at most; segmentation and contours only touch these spans
+//*************************************************************************************************
+class FieldRegion {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		Size frameSize;
+		Rect bounds;			// bounding rectangle of the spans
+		vector<int> spanL, spanR; // span of row y is [spanL[y], spanR[y]), empty if spanL >= spanR
+		Mat mask;				// CV_8UC1, 255 inside
+		vector<Point> polygon;
+
+		//=========================================================================================
+		static vector<Point2d> clip (const vector<Point2d>& poly, double a, double b, double c) {
+			// ----- part of a convex polygon where a*x + b*y + c >= 0 (Sutherland-Hodgman, one edge) -----
+			vector<Point2d> result;
+			for (size_t i = 0; i < poly.size(); i++) {
+				const Point2d& p = poly[i];
+				const Point2d& q = poly[(i + 1) % poly.size()];
+				double dp = a * p.x + b * p.y + c;
+				double dq = a * q.x + b * q.y + c;
+				if (dp >= 0) {
+					result.push_back(p);
+				}
+				if ((dp >= 0) != (dq >= 0)) {
+					double t = dp / (dp - dq);
+					result.push_back(p + t * (q - p));
+				}
+			}
+			return result;
+		}
+
+		//=========================================================================================
+		void setSpansFromMask () {
+			spanL.assign(frameSize.height, 0);
+			spanR.assign(frameSize.height, 0);
+			int top = frameSize.height, bottom = -1, left = frameSize.width, right = 0;
+			for (int y = 0; y < frameSize.height; y++) {
+				const uchar* m = mask.ptr<uchar>(y);
+				int l = 0, r = frameSize.width;
+				while (l < r && m[l] == 0) l++;
+				while (r > l && m[r - 1] == 0) r--;
+				spanL[y] = l;
+				spanR[y] = r;
+				if (l < r) {
+					top = std::min(top, y);
+					bottom = y;
+					left = std::min(left, l);
+					right = std::max(right, r);
+				}
+			}
+			bounds = (bottom >= 0) ? Rect(left, top, right - left, bottom - top + 1) : Rect();
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		FieldRegion () {}
+
+		//=========================================================================================
+		FieldRegion (Size frameSize) : frameSize(frameSize) {
+			// ---------- no restriction: the whole frame ----------
+			mask = Mat(frameSize, CV_8UC1, Scalar(255));
+			polygon = { Point(0, 0), Point(frameSize.width, 0), Point(frameSize.width, frameSize.height), Point(0, frameSize.height) };
+			setSpansFromMask();
+		}
+
+		//=========================================================================================
+		FieldRegion (Camera* camera, Size frameSize, double margin, double headroom) : frameSize(frameSize) {
+
+			// ---------- the pitch with the margin in meters, and its image lifted by the headroom ----------
+			vector<Point2f> corners;
+			Point2d ground[4] = { Point2d(-margin, -margin), Point2d(105 + margin, -margin),
+								  Point2d(105 + margin, 68 + margin), Point2d(-margin, 68 + margin) };
+			Point2d camXY(camera->camCoords.x, camera->camCoords.y);
+			double camZ = camera->camCoords.z;
+			for (int i = 0; i < 4; i++) {
+				corners.push_back(Point2f(ground[i]));
+				if (camZ > headroom && headroom > 0) {
+					// ----- where the ray through a point headroom meters above the corner hits the ground -----
+					Point2d lifted = camXY + (ground[i] - camXY) * (camZ / (camZ - headroom));
+					corners.push_back(Point2f(lifted));
+				}
+			}
+			vector<Point2f> hull;
+			convexHull(corners, hull);
+
+			// ----- meters -> pixels of the field model -----
+			vector<Point2d> modelPoly;
+			for (auto& p : hull) {
+				modelPoly.push_back(Point2d(p.x / MODEL_METERS_PER_PX_X, p.y / MODEL_METERS_PER_PX_Y));
+			}
+
+			// ---------- cut what lies behind (or close to) the horizon of the camera ----------
+			Mat Hinv = camera->homography.inv();
+			const double* w = Hinv.ptr<double>(2);
+			Mat center = camera->homography * (Mat_<double>(3, 1) << 960.0, 540.0, 1.0);
+			center /= center.at<double>(2);
+			double wCenter = w[0] * center.at<double>(0) + w[1] * center.at<double>(1) + w[2];
+			double sgn = (wCenter > 0) ? 1.0 : -1.0;
+			// ----- points with w below 5 % of the one of the view center are far outside the view -----
+			modelPoly = clip(modelPoly, sgn * w[0], sgn * w[1], sgn * w[2] - 0.05 * fabs(wCenter));
+
+			// ---------- field model -> view (1920 x 1080) -> projection flip -> frame ----------
+			vector<Point2d> viewPoly;
+			if (!modelPoly.empty()) {
+				perspectiveTransform(modelPoly, viewPoly, Hinv);
+			}
+			if (camera->projHFlip) {
+				for (auto& p : viewPoly) p.x = 1920 - p.x;
+			}
+			viewPoly = clip(viewPoly, 1, 0, 1);			// x >= -1
+			viewPoly = clip(viewPoly, -1, 0, 1921);		// x <= 1921
+			viewPoly = clip(viewPoly, 0, 1, 1);			// y >= -1
+			viewPoly = clip(viewPoly, 0, -1, 1081);		// y <= 1081
+
+			double sx = double(frameSize.width) / 1920, sy = double(frameSize.height) / 1080;
+			for (auto& p : viewPoly) {
+				polygon.push_back(Point(cvRound(p.x * sx), cvRound(p.y * sy)));
+			}
+
+			mask = Mat::zeros(frameSize, CV_8UC1);
+			if (polygon.size() >= 3) {
+				fillConvexPoly(mask, polygon, Scalar(255));
+			}
+			setSpansFromMask();
+		}
+
+		//=========================================================================================
+		Rect getBounds () {
+			return bounds;
+		}
+
+		//=========================================================================================
+		int getSpanL (int y) {
+			return spanL[y];
+		}
+
+		//=========================================================================================
+		int getSpanR (int y) {
+			return spanR[y];
+		}
+
+		//=========================================================================================
+		Mat& getMask () {
+			return mask;
+		}
+
+		//=========================================================================================
+		vector<Point>& getPolygon () {
+			return polygon;
+		}
+
+		//=========================================================================================
+		bool empty () {
+			return bounds.area() == 0;
+		}
+
+		//=========================================================================================
+		string signature () {
+			// ----- bounds and a hash (FNV-1a) of the spans: equal for equal regions only -----
+			if (empty()) return "full";
+			unsigned int hash = 2166136261u;
+			for (int y = 0; y < frameSize.height; y++) {
+				int span[2] = { spanL[y], spanR[y] };
+				const unsigned char* bytes = (const unsigned char*)span;
+				for (size_t i = 0; i < sizeof(span); i++) {
+					hash = (hash ^ bytes[i]) * 16777619u;
+				}
+			}
+			char text[64];
+			sprintf(text, "%d,%d,%dx%d/%08x", bounds.x, bounds.y, bounds.width, bounds.height, hash);
+			return string(text);
+		}
+
+		//=========================================================================================
+		double coverage () {
+			// ----- share of the frame inside the region -----
+			return double(countNonZero(mask)) / (frameSize.width * frameSize.height);
+		}
+
+		//=========================================================================================
+		~FieldRegion (void) {}
+};
+
+}
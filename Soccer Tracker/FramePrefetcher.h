@@ -0,0 +1,179 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio>
+
+#include "StageProfiler.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- This class decodes video of one camera ahead of the tracking thread.
+// ----- A dedicated decoder-thread reads, resizes and flips frames and stores them in a bounded
+// ----- ring buffer, so the tracking thread only waits for the codec when the ring is empty.
+// ----- Occupancy of the ring is sampled on every read to see whether the decoder keeps up
+//*************************************************************************************************
+class FramePrefetcher {
+
+	typedef chrono::steady_clock Clock;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		int TID;
+		VideoCapture capture;
+		Size frameSize;
+		bool hFlip;
+		int skipFrames;
+
+		// ----- ring buffer of ready frames -----
+		vector<Mat> ring;
+		int head, count;
+		bool finished, stopped;
+
+		mutex mtx;
+		condition_variable notEmpty, notFull;
+		thread decoder;
+
+		// ----- statistics -----
+		int framesRead, underruns, maxOccupancy;
+		double occupancySum, underrunTime; // underrunTime in milliseconds
+
+		//=========================================================================================
+		void decode () {
+			// ---------- decoder-thread: skip frames we are not interested in ----------
+			for (int i = 0; i < skipFrames; i++) {
+				if (!capture.grab()) {
+					break;
+				}
+			}
+
+			Mat raw;
+			while (true) {
+				Mat frame;
+				StageTimer decodeTimer(TID, STAGE_DECODE);
+				bool ok = capture.read(raw);
+				decodeTimer.stop();
+				if (ok) {
+					StageTimer resizeTimer(TID, STAGE_RESIZE_FLIP);
+					resize(raw, frame, frameSize, 0, 0, INTER_AREA);
+					if (hFlip) { flip(frame, frame, 1); } // !!!!! some source videos might be flipped !!!!!
+				}
+
+				unique_lock<mutex> lock(mtx);
+				if (!ok) {
+					finished = true;
+					notEmpty.notify_one();
+					return;
+				}
+				notFull.wait(lock, [&] { return (count < (int)ring.size()) || stopped; });
+				if (stopped) {
+					return;
+				}
+				ring[(head + count) % ring.size()] = frame;
+				count++;
+				notEmpty.notify_one();
+			}
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		FramePrefetcher (int TID, VideoCapture capture, Size frameSize, bool hFlip, int depth, int skipFrames = 0) {
+			this->TID = TID;
+			this->capture = capture;
+			this->frameSize = frameSize;
+			this->hFlip = hFlip;
+			this->skipFrames = skipFrames;
+
+			ring = vector<Mat>(std::max(depth, 1));
+			head = 0;
+			count = 0;
+			finished = false;
+			stopped = false;
+
+			framesRead = 0;
+			underruns = 0;
+			maxOccupancy = 0;
+			occupancySum = 0.0;
+			underrunTime = 0.0;
+		}
+
+		//=========================================================================================
+		void start () {
+			decoder = thread(&FramePrefetcher::decode, this);
+		}
+
+		//=========================================================================================
+		bool read (Mat& frame) {
+			// ---------- tracking-thread: take the oldest ready frame (false when the video ended) ----------
+			StageTimer waitTimer(TID, STAGE_DECODE_WAIT);
+			unique_lock<mutex> lock(mtx);
+
+			occupancySum += count;
+			maxOccupancy = std::max(maxOccupancy, count);
+
+			if (count == 0 && !finished && !stopped) {
+				underruns++;
+				Clock::time_point tic = Clock::now();
+				notEmpty.wait(lock, [&] { return (count > 0) || finished || stopped; });
+				underrunTime += chrono::duration<double, milli>(Clock::now() - tic).count();
+			}
+			if (count == 0) {
+				return false;
+			}
+
+			frame = ring[head];
+			ring[head] = Mat();
+			head = (head + 1) % ring.size();
+			count--;
+			framesRead++;
+			notFull.notify_one();
+			return true;
+		}
+
+		//=========================================================================================
+		void stop () {
+			{
+				lock_guard<mutex> lock(mtx);
+				stopped = true;
+			}
+			notFull.notify_all();
+			notEmpty.notify_all();
+			if (decoder.joinable()) {
+				decoder.join();
+			}
+		}
+
+		//=========================================================================================
+		double getAvgOccupancy () {
+			lock_guard<mutex> lock(mtx);
+			return (framesRead == 0) ? 0.0 : occupancySum / framesRead;
+		}
+
+		//=========================================================================================
+		void printReport () {
+			lock_guard<mutex> lock(mtx);
+			double avgOccupancy = (framesRead == 0) ? 0.0 : occupancySum / framesRead;
+			printf("camera %d prefetch: depth %d, avg occupancy %.2f, max %d, %d underruns (%.1f ms waited)\n",
+				TID, (int)ring.size(), avgOccupancy, maxOccupancy, underruns, underrunTime);
+			fflush(stdout);
+		}
+
+		//=========================================================================================
+		~FramePrefetcher (void) {
+			stop();
+		}
+};
+
+}
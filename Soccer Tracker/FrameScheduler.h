@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+
+#include "StageProfiler.h"
+
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- This class keeps the frame bookkeeping of the tracking pipeline: which TrackInfo and
+// ----- fused-ball slots belong to which frame, and how long the result of every camera had to
+// ----- wait for the slowest camera, so the straggler (the camera the others wait for) can be identified.
+// ----- With staleness 1 cameras track frame t with the fused ball state of frame t-2 and their
+// ----- whole work overlaps the fusion of frame t-1, 0 is the lockstep mode. The frame driver joins
+// ----- the cameras on every frame, so they are never more than one frame ahead of the fusion:
+// ----- a larger staleness would only feed older fused states to the tracking and is clamped to 1
+//*************************************************************************************************
+class FrameScheduler {
+
+	typedef chrono::steady_clock Clock;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		int camerasCnt, staleness, framesFused, lastFinished;
+
+		mutex mtx;
+		Clock::time_point frameStart;
+		vector<Clock::time_point> finishTime;
+
+		// ----- statistics (milliseconds) -----
+		vector<double> lastWait, totalWait, maxWait;
+		vector<int> waitCnt, stragglerCnt;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		static const int MAX_STALENESS = 1;
+
+		//=========================================================================================
+		FrameScheduler (int camerasCnt, int staleness = 0) {
+			this->camerasCnt = camerasCnt;
+			this->staleness = std::min(std::max(staleness, 0), MAX_STALENESS);
+			framesFused = 0;
+			lastFinished = -1;
+
+			finishTime = vector<Clock::time_point>(camerasCnt);
+
+			lastWait  = vector<double>(camerasCnt, 0.0);
+			totalWait = vector<double>(camerasCnt, 0.0);
+			maxWait   = vector<double>(camerasCnt, 0.0);
+			waitCnt   = vector<int>(camerasCnt, 0);
+			stragglerCnt = vector<int>(camerasCnt, 0);
+		}
+
+		//=========================================================================================
+		int getStaleness () {
+			return staleness;
+		}
+
+		//=========================================================================================
+		int getTrackSlotsCnt () {
+			// ----- TrackInfo of staleness+1 frames may be tracked but not fused yet -----
+			return staleness + 1;
+		}
+
+		//=========================================================================================
+		int getFusedSlotsCnt () {
+			// ----- one slot more: the next frame is tracked while the current one is being fused -----
+			return staleness + 2;
+		}
+
+		//=========================================================================================
+		int getFusedCount () {
+			lock_guard<mutex> lock(mtx);
+			return framesFused;
+		}
+
+		//=========================================================================================
+		void beginFrame () {
+			// ---------- camera stages of a new frame are about to be started ----------
+			lock_guard<mutex> lock(mtx);
+			frameStart = Clock::now();
+			for (int i = 0; i < camerasCnt; i++) {
+				finishTime[i] = frameStart;
+			}
+		}
+
+		//=========================================================================================
+		void cameraDone (int TID) {
+			// ---------- called from the task of camera TID when its TrackInfo is ready ----------
+			lock_guard<mutex> lock(mtx);
+			finishTime[TID] = Clock::now();
+		}
+
+		//=========================================================================================
+		void endFrame () {
+			// ---------- every camera is done: its result waited for the slowest one ----------
+			lock_guard<mutex> lock(mtx);
+			Clock::time_point last = *max_element(finishTime.begin(), finishTime.end());
+			lastFinished = int(max_element(finishTime.begin(), finishTime.end()) - finishTime.begin());
+			stragglerCnt[lastFinished]++;
+
+			for (int i = 0; i < camerasCnt; i++) {
+				double waited = chrono::duration<double, milli>(last - finishTime[i]).count();
+				lastWait[i] = waited;
+				totalWait[i] += waited;
+				maxWait[i] = std::max(maxWait[i], waited);
+				waitCnt[i]++;
+				StageProfiler::record(i, STAGE_BARRIER_WAIT, waited * 1000.0);
+			}
+		}
+
+		//=========================================================================================
+		void frameFused () {
+			lock_guard<mutex> lock(mtx);
+			framesFused++;
+		}
+
+		//=========================================================================================
+		void logFrame (ofstream& file, int frame) {
+			// ---------- write the last waiting time of every camera and the camera that completed the frame last ----------
+			lock_guard<mutex> lock(mtx);
+			file << frame;
+			for (int i = 0; i < camerasCnt; i++) {
+				file << " " << lastWait[i];
+			}
+			file << " " << lastFinished + 1 << endl;
+		}
+
+		//=========================================================================================
+		void printReport () {
+			lock_guard<mutex> lock(mtx);
+			if (staleness == 0)	printf("frame synchronization, lockstep (%d frames):\n", framesFused);
+			else				printf("frame synchronization, staleness %d (%d frames):\n", staleness, framesFused);
+			for (int i = 0; i < camerasCnt; i++) {
+				double avgWait = (waitCnt[i] == 0) ? 0.0 : totalWait[i] / waitCnt[i];
+				printf("  camera %d waited avg %.2f ms, max %.2f ms, was the last one %d times\n",
+					i, avgWait, maxWait[i], stragglerCnt[i]);
+			}
+			fflush(stdout);
+		}
+
+		//=========================================================================================
+		~FrameScheduler (void) {}
+};
+
+}
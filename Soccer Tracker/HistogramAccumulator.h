@@ -0,0 +1,102 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <vector>
+#include <algorithm>
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Average of the last N histograms of the background. The histograms are kept in a ring
+// ----- of raw bins next to their running sum: adding one costs O(bins), nothing is allocated
+// ----- after construction and the memory does not grow with the length of the match.
+// ----- The sum is kept in doubles, the bins are counts (integers), so it never drifts
+//*************************************************************************************************
+class HistogramAccumulator {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		int bins, capacity;
+		int head, size;			// next slot of the ring, number of histograms in it
+		vector<float> ring;		// capacity x bins
+		vector<double> sum;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		HistogramAccumulator (int bins, int capacity) : bins(bins), capacity(std::max(capacity, 1)),
+			head(0), size(0), ring(size_t(std::max(capacity, 1)) * bins, 0.0f), sum(bins, 0.0) {}
+
+		//=========================================================================================
+		void add (const MatND& hist) {
+			// ---------- hist: bins x 1, CV_32FC1 ----------
+			CV_Assert(hist.type() == CV_32FC1 && int(hist.total()) == bins && hist.isContinuous());
+			const float* src = hist.ptr<float>();
+			float* slot = &ring[size_t(head) * bins];
+
+			if (size == capacity) {
+				for (int b = 0; b < bins; b++) {
+					sum[b] += double(src[b]) - double(slot[b]);
+				}
+			} else {
+				for (int b = 0; b < bins; b++) {
+					sum[b] += src[b];
+				}
+				size++;
+			}
+			std::copy(src, src + bins, slot);
+			head = (head + 1) % capacity;
+		}
+
+		//=========================================================================================
+		void getModel (MatND& model) {
+			// ---------- the mean of the accumulated histograms (reuses the buffer of model) ----------
+			model.create(bins, 1, CV_32FC1);
+			float* dst = model.ptr<float>();
+			double scale = (size > 0) ? 1.0 / size : 0.0;
+			for (int b = 0; b < bins; b++) {
+				dst[b] = float(sum[b] * scale);
+			}
+		}
+
+		//=========================================================================================
+		void setModel (const MatND& model, int weight) {
+			// ---------- start from a known background, as if it was seen in the last weight frames ----------
+			clear();
+			for (int i = 0; i < std::min(weight, capacity); i++) {
+				add(model);
+			}
+		}
+
+		//=========================================================================================
+		void clear () {
+			std::fill(sum.begin(), sum.end(), 0.0);
+			head = 0;
+			size = 0;
+		}
+
+		//=========================================================================================
+		int getSize () {
+			return size;
+		}
+
+		//=========================================================================================
+		int getCapacity () {
+			return capacity;
+		}
+
+		//=========================================================================================
+		int getBins () {
+			return bins;
+		}
+
+		//=========================================================================================
+		~HistogramAccumulator (void) {}
+};
+
+}
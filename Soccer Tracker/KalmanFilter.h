@@ -23,6 +23,9 @@ class KalmanFilter {
 		Mat_<float> state;
 		Mat measure, estimated, prediction;
 
+		Matx22f innovationCov;	// running mean of the observed innovations (measurement - prediction)
+		float innovationRate;
+
 		bool initialized;
 
 	//_____________________________________________________________________________________________
@@ -33,6 +36,10 @@ class KalmanFilter {
 			
 			initialized = false;
 
+			// ----- nothing is known at the start: 10 pixels in both directions -----
+			innovationCov = Matx22f(100.0f, 0.0f, 0.0f, 100.0f);
+			innovationRate = 0.2f;
+
 			KF = cv::KalmanFilter(4, 2, 0);
 			measure = Mat(2,1, CV_32F);
 			measure.setTo(Scalar(1));
@@ -74,6 +81,10 @@ class KalmanFilter {
 
 			prediction = KF.predict();
 
+			// ----- how far the measurement landed from the prediction -----
+			Matx21f innovation(p.x - prediction.at<float>(0), p.y - prediction.at<float>(1));
+			innovationCov = innovationCov * (1.0f - innovationRate) + (innovation * innovation.t()) * innovationRate;
+
 			measure.at<float>(0) = p.x;
 			measure.at<float>(1) = p.y;
 			estimated = KF.correct(measure);
@@ -97,6 +108,19 @@ class KalmanFilter {
 			return Point2f(estimated.at<float>(0), estimated.at<float>(1));
 		}
 
+		//=========================================================================================
+		Point2f peek (Matx22f& uncertainty) {
+			// ---------- position predicted for the next frame, without advancing the filter, and the
+			// ---------- covariance of the coming innovation: the one of the model or the observed one,
+			// ---------- whichever is larger (the noise of the model is not tuned in pixels) ----------
+			Mat x = KF.transitionMatrix * KF.statePost;
+			Mat P = KF.transitionMatrix * KF.errorCovPost * KF.transitionMatrix.t() + KF.processNoiseCov;
+			Mat S = KF.measurementMatrix * P * KF.measurementMatrix.t() + KF.measurementNoiseCov;
+			Matx22f model(S.at<float>(0, 0), S.at<float>(0, 1), S.at<float>(1, 0), S.at<float>(1, 1));
+			uncertainty = (trace(model) > trace(innovationCov)) ? model : innovationCov;
+			return Point2f(x.at<float>(0), x.at<float>(1));
+		}
+
 		//=========================================================================================
 		~KalmanFilter(void) {}
 
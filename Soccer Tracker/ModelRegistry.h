@@ -0,0 +1,116 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <memory>
+#include <mutex>
+
+#include "TaskPool.h"
+#include "BallTemplateBank.h"
+#include "CorrelationCache.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- What tells the teams apart: mean players of the classifier (1 x 2700: 20 x 45 planes
+// ----- B, G, R) and the player templates
+//*************************************************************************************************
+struct TeamModel {
+
+	Mat teamA, teamB, referee;
+	Mat tmplate[3];		// White.png, Blue.png, Referee.png
+};
+
+//*************************************************************************************************
+// ----- Process-wide read-only models. The team model is loaded once (its files in parallel when
+// ----- a pool is given) and the ball template banks are made once for every radius range, step
+// ----- and background colour; all trackers of all cameras get const references to the same data
+//*************************************************************************************************
+class ModelRegistry {
+
+	typedef tuple<double, double, double, double, double, double> BankKey;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		once_flag teamsLoaded;
+		TeamModel teams;
+
+		mutex banksMtx;
+		map<BankKey, unique_ptr<BallTemplateBank>> ballBanks;
+
+		//=========================================================================================
+		ModelRegistry () {}
+
+		//=========================================================================================
+		void loadTeams (TaskPool* pool) {
+			// ---------- five files, no one depends on another ----------
+			Mat classifier;
+			parallelFor(pool, 5, [&](int i) {
+				switch (i) {
+					case 0: {
+						FileStorage fs("classifier.xml", FileStorage::READ);
+						fs["some_name"] >> classifier;
+						break;
+					}
+					case 1: {
+						FileStorage fs("Referee.xml", FileStorage::READ);
+						fs["Referee"] >> teams.referee;
+						break;
+					}
+					case 2: teams.tmplate[0] = imread("White.png");		break;
+					case 3: teams.tmplate[1] = imread("Blue.png");		break;
+					case 4: teams.tmplate[2] = imread("Referee.png");	break;
+				}
+			});
+			if (classifier.rows >= 2) {
+				teams.teamA = classifier.row(0).clone();
+				teams.teamB = classifier.row(1).clone();
+			}
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		static ModelRegistry& instance () {
+			static ModelRegistry registry;
+			return registry;
+		}
+
+		//=========================================================================================
+		void load (TaskPool* pool = NULL) {
+			// ----- the first call loads, the others (and the ones meanwhile) wait for it -----
+			call_once(teamsLoaded, [this, pool] { loadTeams(pool); });
+		}
+
+		//=========================================================================================
+		const TeamModel& getTeamModel () {
+			load();
+			return teams;
+		}
+
+		//=========================================================================================
+		const BallTemplateBank& getBallBank (double minRad, double maxRad, double step, Scalar backGrColor) {
+			// ----- the spectra are made for the tiles of the shared correlation -----
+			lock_guard<mutex> lock(banksMtx);
+			BankKey key(minRad, maxRad, step, backGrColor[0], backGrColor[1], backGrColor[2]);
+			unique_ptr<BallTemplateBank>& bank = ballBanks[key];
+			if (!bank) {
+				Size block(CorrelationCache::TILE, CorrelationCache::TILE);
+				bank.reset(new BallTemplateBank(minRad, maxRad, step, backGrColor, block));
+			}
+			return *bank;
+		}
+
+		//=========================================================================================
+		~ModelRegistry (void) {}
+};
+
+}
@@ -5,6 +5,7 @@
 #include "KalmanFilter.h"
 #include "TrackInfo.h"
 #include "Tracker.h"
+#include "StageProfiler.h"
 
 #include <map>
 #include <utility>
@@ -119,7 +120,7 @@ struct ProjCandidate {
 		coordsKF.push_back(_coordsKF);
 
 		// Push back coordinate (convert pixel to meters)
-		coords_meters.push_back(Point2f(_coordsKF.x * 0.05464, _coordsKF.y * 0.06291));
+		coords_meters.push_back(Point2f(_coordsKF.x * MODEL_METERS_PER_PX_X, _coordsKF.y * MODEL_METERS_PER_PX_Y));
 
 		/********************************************************************************
 				Projects the predicted 2D coordinates of mainCandidate ( frame t + 1 ) Not in use
@@ -166,7 +167,7 @@ struct ProjCandidate {
 
 	}
 
-	void updatePlayer(PlayerCandidate* ti, int frameCnt, bool flipH) {
+	void updatePlayer(const PlayerInfo* ti, int frameCnt, bool flipH) {
 
 		vector<Point2f> p_orig = vector<Point2f>(1);
 		vector<Point2f> p_proj = vector<Point2f>(1);
@@ -202,7 +203,7 @@ struct ProjCandidate {
 		coordsKF.push_back(_coordsKF);
 
 		// Push back coordinate (convert pixel to meters)
-		coords_meters.push_back(Point2f(_coordsKF.x * 0.05464, _coordsKF.y * 0.06291));
+		coords_meters.push_back(Point2f(_coordsKF.x * MODEL_METERS_PER_PX_X, _coordsKF.y * MODEL_METERS_PER_PX_Y));
 
 		/********************************************************************************
 		Others
@@ -386,8 +387,10 @@ class MultiCameraTracker {
 				vector<ProjCandidate*> used;
 
 				// Loop through all candidates of camera i
-				for (auto p : trackInfo[i].pCandidates)
+				for (auto& player : trackInfo[i].players)
 				{
+					const PlayerInfo* p = &player;
+
 					// ID of player
 					int candidateID = p->id;					
 					bool exists = false;
@@ -443,16 +446,22 @@ class MultiCameraTracker {
 		void process(ofstream& file, int globalFrameCount) {
 			
 			// True positive identification
+			StageTimer identifyTimer(StageProfiler::FUSION, STAGE_IDENTIFY_TP);
 			identifyTruePositive(file, globalFrameCount);
 			
 			// Object handover
 			objectHandover();
+			identifyTimer.stop();
 
 			// 3D estimation
+			StageTimer coordsTimer(StageProfiler::FUSION, STAGE_COMPUTE_3D);
 			compute3D_Coords();
+			coordsTimer.stop();
 				
 			// Camera handoff for frame t + 1
+			StageTimer handoffTimer(StageProfiler::FUSION, STAGE_CAMERA_HANDOFF);
 			cameraHandoff();
+			handoffTimer.stop();
 
 		}
 
@@ -665,7 +674,7 @@ class MultiCameraTracker {
 							vector<Point2f> p_proj = vector<Point2f>(1);
 
 							p_orig[0] = Inv_Triangulate(tempBall[0]->cameraVisible[i]->camCoords, finalPoint3D);
-							p_orig[0] = Point(p_orig[0].x / 0.05464, p_orig[0].y / 0.06291);
+							p_orig[0] = Point(p_orig[0].x / MODEL_METERS_PER_PX_X, p_orig[0].y / MODEL_METERS_PER_PX_Y);
 							
 							perspectiveTransform(p_orig, p_proj, tempBall[0]->cameraVisible[i]->homography.inv());
 
@@ -1134,6 +1143,23 @@ class MultiCameraTracker {
 			//}
 		}
 
+		//=========================================================================================
+		vector<ProjCandidate> getTruePositivesSnapshot () {
+			// ----- copies of the true positives holding only what camera-threads read (camera ID, last 3D point),
+			// ----- so cameras can keep tracking while the next frame is being fused -----
+			vector<ProjCandidate> snapshot;
+
+			for (auto cc : currCandidates)	if (cc->isRealBall)
+			{
+				ProjCandidate copy(cc->ID, cc->cameraID, cc->camCoords, cc->homography);
+				copy.isRealBall = true;
+				if (!cc->coords3D.empty()) copy.coords3D.push_back(cc->coords3D.back());
+				snapshot.push_back(copy);
+			}
+
+			return snapshot;
+		}
+
 		//=========================================================================================
 		Point Inv_Triangulate(Point3d cam, Point3d ball) {
 
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <chrono>
+
+#include "PlayerCandidate.h"
+#include "ModelRegistry.h"
+#include "PeakFinder.h"
+#include "TaskPool.h"
+#include "globalSettings.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Splits a blob that several tracked players merged into: every player of the group is
+// ----- placed where the template of its team matches the foreground best, each channel on its
+// ----- own, and the place is then taken for the others. The foreground planes are split once per
+// ----- frame (only under the groups), the templates are scaled once for every frame row, and
+// ----- the groups are solved in parallel. A group that would start after the budget of the
+// ----- frame is over is left to the prediction of its players
+//*************************************************************************************************
+class OcclusionSolver {
+
+	typedef chrono::steady_clock Clock;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		struct PlayerTemplate {
+			Mat planes[3];
+		};
+
+		map<int, PlayerTemplate> templates;	// key: (team * 1000 + width) * 1000 + height
+		Mat planes[3];						// B, G, R of the foreground, valid under the groups of the frame
+		TaskPool* pool;
+		double budgetMs;
+
+		atomic<int> solvedGroups, skippedGroups;
+
+		//=========================================================================================
+		static int key (int team, Size size) {
+			return (team * 1000 + size.width) * 1000 + size.height;
+		}
+
+		//=========================================================================================
+		const PlayerTemplate* getTemplate (int team, Size size) {
+			auto t = templates.find(key(team, size));
+			return (t == templates.end()) ? NULL : &t->second;
+		}
+
+		//=========================================================================================
+		void solveGroup (vector<PlayerCandidate*>& group, Rect roi) {
+			Size ts = templateSize(roi.br().y);
+			if (roi.width < ts.width || roi.height < ts.height) return;
+
+			Size mapSize(roi.width - ts.width + 1, roi.height - ts.height + 1);
+			Mat weight(mapSize, CV_32FC1, Scalar(1.0));
+			Mat scores[3];
+
+			for (auto p : group) {
+				int team = p->teamID;
+				const PlayerTemplate* t = (team >= 0 && team < 3) ? getTemplate(team, ts) : NULL;
+				if (t == NULL) continue;
+
+				// ---------- mean of the channel correlations, once per team of the group ----------
+				if (scores[team].empty()) {
+					scores[team] = Mat::zeros(mapSize, CV_32FC1);
+					Mat corr;
+					for (int c = 0; c < 3; c++) {
+						matchTemplate(planes[c](roi), t->planes[c], corr, CV_TM_CCORR_NORMED);
+						scores[team] += corr;
+					}
+					scores[team] *= 1.0 / 3;
+				}
+
+				vector<Point> peak;
+				vector<double> value;
+				PeakFinder::findPeaks(scores[team], weight, 1, 0, peak, value);
+				if (peak.empty() || value[0] <= 0) continue;
+
+				// ----- the place is taken: nobody else of the group is centred inside this player -----
+				weight(Rect(peak[0] - Point(ts.width / 2, ts.height / 2), ts) & Rect(Point(), mapSize)) = 0.0;
+
+				Rect bb(roi.tl() + peak[0], ts);
+				p->curCrd = Point(bb.x + bb.width / 2, bb.y + bb.height);
+				p->curRect = bb;
+				p->playerLikelihood = float(value[0]);
+				p->Occlusion = true;
+				p->predictTime--;
+			}
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		OcclusionSolver () : pool(NULL), budgetMs(OCCLUSION_BUDGET_MS), solvedGroups(0), skippedGroups(0) {}
+
+		//=========================================================================================
+		static Size templateSize (int bottomY) {
+			// ----- expected size of a player standing on this row -----
+			return Size((10 * bottomY / 540) + 25, (30 * bottomY / 540) + 25);
+		}
+
+		//=========================================================================================
+		void setTeamModel (const TeamModel& teams, int rows) {
+			// ---------- every template at every size a group can ask for ----------
+			templates.clear();
+			for (int team = 0; team < 3; team++) {
+				if (teams.tmplate[team].empty()) continue;
+				for (int y = 0; y <= rows; y++) {
+					Size size = templateSize(y);
+					if (getTemplate(team, size) != NULL) continue;
+					Mat resized;
+					resize(teams.tmplate[team], resized, size, 0, 0, INTER_AREA);
+					split(resized, templates[key(team, size)].planes);
+				}
+			}
+		}
+
+		//=========================================================================================
+		void setTaskPool (TaskPool* pool) {
+			this->pool = pool;
+		}
+
+		//=========================================================================================
+		void setBudget (double milliseconds) {
+			budgetMs = milliseconds;
+		}
+
+		//=========================================================================================
+		static vector<vector<PlayerCandidate*>> findGroups (vector<PlayerCandidate*>& players) {
+			// ---------- a player whose rectangle grew over the centres of smaller ones; every player
+			// ---------- is in one group at most, so the groups can be solved independently ----------
+			vector<vector<PlayerCandidate*>> groups;
+			vector<char> used(players.size(), 0);
+			for (size_t i = 0; i < players.size(); i++) {
+				if (used[i]) continue;
+				PlayerCandidate* cand1 = players[i];
+				vector<size_t> members(1, i);
+
+				for (size_t j = 0; j < players.size() && int(members.size()) < OCCLUSION_MAX_GROUP; j++) {
+					// Same player or not enough data to process
+					if (i == j || used[j] || players[j]->prevRects.size() < 2) continue;
+
+					PlayerCandidate* cand2 = players[j];
+					Point cand2Crd = Point(cand2->curCrd.x, cand2->curCrd.y - cand2->curRect.height / 2);
+
+					// Center of other player is inside of current player and their areas differ significantly
+					if (cand1->curRect.contains(cand2Crd) && cand1->curRect.area() > 1.7 * cand2->curRect.area()) {
+						members.push_back(j);
+					}
+				}
+
+				if (members.size() > 1) {
+					groups.push_back(vector<PlayerCandidate*>());
+					for (auto m : members) {
+						used[m] = 1;
+						groups.back().push_back(players[m]);
+					}
+				}
+			}
+			return groups;
+		}
+
+		//=========================================================================================
+		void solve (vector<PlayerCandidate*>& players, Mat& frame, Mat& mask) {
+			if (templates.empty()) return;
+			vector<vector<PlayerCandidate*>> groups = findGroups(players);
+			if (groups.empty()) return;
+
+			// ---------- foreground planes under the groups (the buffers are kept between frames) ----------
+			Rect bounds(0, 0, frame.cols, frame.rows);
+			vector<Rect> rois;
+			for (int c = 0; c < 3; c++) {
+				planes[c].create(frame.size(), CV_8UC1);
+			}
+			for (auto& group : groups) {
+				Rect roi = group[0]->curRect;
+				for (auto p : group) roi |= p->curRect;
+				roi &= bounds;
+				rois.push_back(roi);
+				if (roi.area() == 0) continue;
+
+				Mat sub[3] = { planes[0](roi), planes[1](roi), planes[2](roi) };
+				split(frame(roi), sub);
+				Mat background = (mask(roi) == 0);
+				for (int c = 0; c < 3; c++) {
+					sub[c].setTo(Scalar(0), background);
+				}
+			}
+
+			// ---------- groups in parallel, none is started after the budget ----------
+			Clock::time_point start = Clock::now();
+			parallelFor(pool, int(groups.size()), [&](int g) {
+				double elapsed = chrono::duration<double, milli>(Clock::now() - start).count();
+				if (elapsed > budgetMs || rois[g].area() == 0) {
+					skippedGroups++;
+					return;
+				}
+				solveGroup(groups[g], rois[g]);
+				solvedGroups++;
+			});
+		}
+
+		//=========================================================================================
+		int getSolvedGroups () {
+			return solvedGroups;
+		}
+
+		//=========================================================================================
+		int getSkippedGroups () {
+			return skippedGroups;
+		}
+
+		//=========================================================================================
+		~OcclusionSolver (void) {}
+};
+
+}
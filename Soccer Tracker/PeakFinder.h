@@ -0,0 +1,122 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <emmintrin.h>
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- The K best positions of a correlation map, weighted by a mask (the restricted area),
+// ----- in one pass. Every row is reduced to its best weighted value while the map is read (SSE2,
+// ----- product and maximum in one loop); the peaks are then taken greedily from the row maxima
+// ----- and only the rows around a taken peak (+- nmsRadius) are read again. With nmsRadius 0
+// ----- the result is the same as minMaxLoc repeated K times with the maximum overwritten
+//*************************************************************************************************
+class PeakFinder {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		//=========================================================================================
+		static float rowMax (const float* c, const float* w, int from, int to, int& idx) {
+			// ---------- best of c[x] * w[x] on [from, to), idx is the first x holding it ----------
+			float best = -FLT_MAX;
+			int x = from;
+			if (to - from >= 8) {
+				__m128 vbest = _mm_set1_ps(-FLT_MAX);
+				if (w) {
+					for (; x <= to - 4; x += 4) {
+						vbest = _mm_max_ps(vbest, _mm_mul_ps(_mm_loadu_ps(c + x), _mm_loadu_ps(w + x)));
+					}
+				} else {
+					for (; x <= to - 4; x += 4) {
+						vbest = _mm_max_ps(vbest, _mm_loadu_ps(c + x));
+					}
+				}
+				vbest = _mm_max_ps(vbest, _mm_shuffle_ps(vbest, vbest, _MM_SHUFFLE(1, 0, 3, 2)));
+				vbest = _mm_max_ps(vbest, _mm_shuffle_ps(vbest, vbest, _MM_SHUFFLE(2, 3, 0, 1)));
+				best = _mm_cvtss_f32(vbest);
+			}
+			for (; x < to; x++) {
+				best = std::max(best, w ? c[x] * w[x] : c[x]);
+			}
+
+			// ----- the products are exact in both paths, the first position holding the best wins -----
+			idx = -1;
+			for (x = from; x < to; x++) {
+				if ((w ? c[x] * w[x] : c[x]) >= best) {
+					idx = x;
+					break;
+				}
+			}
+			return best;
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		static void findPeaks (const Mat& corr, const Mat& weight, int k, int nmsRadius, vector<Point>& points, vector<double>& values) {
+			// ---------- corr, weight: CV_32FC1 of the same size (weight may be empty) ----------
+			// ---------- the positions within nmsRadius (square) of a taken peak are not taken again ----------
+			points.clear();
+			values.clear();
+			if (corr.empty() || k <= 0) return;
+			CV_Assert(corr.type() == CV_32FC1 && (weight.empty() || (weight.type() == CV_32FC1 && weight.size() == corr.size())));
+
+			int rows = corr.rows, cols = corr.cols;
+			vector<float> best(rows);
+			vector<int> bestX(rows);
+			for (int y = 0; y < rows; y++) {
+				best[y] = rowMax(corr.ptr<float>(y), weight.empty() ? 0 : weight.ptr<float>(y), 0, cols, bestX[y]);
+			}
+
+			for (int i = 0; i < k; i++) {
+				// ----- the best row, the first one on ties (raster order, as minMaxLoc) -----
+				int by = -1;
+				for (int y = 0; y < rows; y++) {
+					if (bestX[y] >= 0 && (by < 0 || best[y] > best[by])) by = y;
+				}
+				if (by < 0) break;
+				points.push_back(Point(bestX[by], by));
+				values.push_back(best[by]);
+
+				// ---------- read again the rows the new peak suppresses something in ----------
+				for (int y = std::max(by - nmsRadius, 0); y <= std::min(by + nmsRadius, rows - 1); y++) {
+					// ----- the parts of the row outside of all suppressed squares -----
+					vector<pair<int, int>> blocked;
+					for (auto& p : points) {
+						if (abs(p.y - y) <= nmsRadius) blocked.push_back(make_pair(p.x - nmsRadius, p.x + nmsRadius + 1));
+					}
+					sort(blocked.begin(), blocked.end());
+
+					const float* c = corr.ptr<float>(y);
+					const float* w = weight.empty() ? 0 : weight.ptr<float>(y);
+					best[y] = -FLT_MAX;
+					bestX[y] = -1;
+					int from = 0;
+					for (size_t b = 0; b <= blocked.size(); b++) {
+						int to = (b < blocked.size()) ? std::min(std::max(blocked[b].first, from), cols) : cols;
+						if (to > from) {
+							int idx;
+							float v = rowMax(c, w, from, to, idx);
+							if (idx >= 0 && (bestX[y] < 0 || v > best[y])) {
+								best[y] = v;
+								bestX[y] = idx;
+							}
+						}
+						if (b < blocked.size()) from = std::max(from, blocked[b].second);
+						if (from >= cols) break;
+					}
+				}
+			}
+		}
+};
+
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "CameraHandler.h"
+#include "globalSettings.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- How big things look on every row of the frame of one camera. Objects on the bottom row
+// ----- have scale 1, on the top row perspectiveRatio (linear in between). All per-row values
+// ----- (window scale, expected ball radius and its template) are tabulated once, so the
+// ----- trackers and the contour analysis get them by one lookup
+//*************************************************************************************************
+class PerspectiveModel {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		int rows;
+		double ratio;
+		vector<float> scale;		// relative size of objects on row y
+		vector<float> ballRadius;	// expected radius of the ball on row y, pixels
+		vector<int> templIdx;		// ball template closest to that radius
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		PerspectiveModel () : rows(0), ratio(1.0) {}
+
+		//=========================================================================================
+		PerspectiveModel (double perspectiveRatio, int rows) : rows(rows), ratio(perspectiveRatio) {
+			scale.resize(rows);
+			for (int y = 0; y < rows; y++) {
+				scale[y] = float(ratio + (1 - ratio) * double(y) / rows);
+			}
+		}
+
+		//=========================================================================================
+		static double ratioFromHomography (Camera* camera, Size frameSize, double height = 1.8) {
+			// ---------- ratio of the image heights of an object on the top and on the bottom row (frame
+			// ---------- center column): its top is projected to the ground through the camera position ----------
+			Mat Hinv = camera->homography.inv();
+			double sx = 1920.0 / frameSize.width, sy = 1080.0 / frameSize.height;
+			double camZ = camera->camCoords.z;
+			if (camZ <= height) return 1.0;
+
+			double size[2];
+			int rowsAt[2] = { 0, frameSize.height - 1 };
+			for (int i = 0; i < 2; i++) {
+				Point2d foot(frameSize.width / 2.0, rowsAt[i]);
+				Point2d view(foot.x * sx, foot.y * sy);
+				if (camera->projHFlip) view.x = 1920 - view.x;
+				vector<Point2d> p(1, view), model;
+				perspectiveTransform(p, model, camera->homography);
+
+				// ----- model pixels -> meters, lift, and back -----
+				Point2d ground(model[0].x * MODEL_METERS_PER_PX_X, model[0].y * MODEL_METERS_PER_PX_Y);
+				Point2d camXY(camera->camCoords.x, camera->camCoords.y);
+				Point2d lifted = camXY + (ground - camXY) * (camZ / (camZ - height));
+				vector<Point2d> q(1, Point2d(lifted.x / MODEL_METERS_PER_PX_X, lifted.y / MODEL_METERS_PER_PX_Y)), back;
+				perspectiveTransform(q, back, Hinv);
+				if (camera->projHFlip) back[0].x = 1920 - back[0].x;
+				size[i] = norm(Point2d(back[0].x / sx, back[0].y / sy) - foot);
+			}
+			return (size[1] > 0) ? std::min(size[0] / size[1], 1.0) : 1.0;
+		}
+
+		//=========================================================================================
+		void setBallTemplates (const vector<Mat>& ballTempls) {
+			vector<float> templRad;
+			for (auto& t : ballTempls) {
+				templRad.push_back(float((t.rows - 1) / 2));
+			}
+			setBallTemplates(templRad);
+		}
+
+		//=========================================================================================
+		void setBallTemplates (const vector<float>& templRad) {
+			// ---------- radiuses of the templates, ordered: the largest one is the ball on the bottom row ----------
+			ballRadius.assign(rows, 0.0f);
+			templIdx.assign(rows, 0);
+			if (templRad.empty()) return;
+
+			float nearRad = templRad.back();
+			for (int y = 0; y < rows; y++) {
+				ballRadius[y] = nearRad * scale[y];
+				int best = 0;
+				for (int i = 1; i < int(templRad.size()); i++) {
+					if (fabs(templRad[i] - ballRadius[y]) < fabs(templRad[best] - ballRadius[y])) best = i;
+				}
+				templIdx[y] = best;
+			}
+		}
+
+		//=========================================================================================
+		inline float getScale (int y) {
+			if (y >= 0 && y < rows) return scale[y];
+			return float(ratio + (1 - ratio) * double(y) / std::max(rows, 1));
+		}
+
+		//=========================================================================================
+		inline Point scaleRad (Point rad, int y) {
+			double s = getScale(y);
+			return Point(int(s * rad.x), int(s * rad.y));
+		}
+
+		//=========================================================================================
+		inline int getTemplIdx (int y) {
+			if (templIdx.empty()) return 0;
+			return templIdx[std::min(std::max(y, 0), rows - 1)];
+		}
+
+		//=========================================================================================
+		inline float getBallRadius (int y) {
+			if (ballRadius.empty()) return 0.0f;
+			return ballRadius[std::min(std::max(y, 0), rows - 1)];
+		}
+
+		//=========================================================================================
+		int getRows () {
+			return rows;
+		}
+
+		//=========================================================================================
+		double getRatio () {
+			return ratio;
+		}
+
+		//=========================================================================================
+		~PerspectiveModel (void) {}
+};
+
+}
@@ -23,6 +23,8 @@ class PlayerCandidate {
 		int updateTime;
 		int predictTime;
 		int teamID;
+		int teamCheckTime;		// frame the team was last classified in
+		double teamConfidence;
 
 		bool Occlusion;
 		bool Predict = false;
@@ -61,6 +63,8 @@ class PlayerCandidate {
 			this->curCrd = crd;
 			this->curRect = rect;
 			this->teamID = teamID;
+			this->teamCheckTime = time;
+			this->teamConfidence = 1.0;
 			this->Occlusion = Occlusion;
 			
 			updateTime = lifeTime;
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Options selected at runtime from the command line:
+// -----   --headless     no windows, no drawing, no waiting for keys (batch processing on servers)
+// -----   --frames N     stop after N frames have been fused
+// -----   --profile N    print the stage latencies every N frames
+// -----   --cameras N    track only the first N cameras (stress tests with fewer/more load)
+// -----   --synthetic    render a synthetic match instead of reading the dataset, its scene is set by:
+// -----     --players N        number of players on the pitch (with a referee)
+// -----     --resolution WxH   resolution of the rendered videos
+// -----     --length N         number of rendered frames
+// -----     --seed N           seed of the scene, equal seeds give equal videos
+//*************************************************************************************************
+struct RunOptions {
+
+	bool headless;
+	int maxFrames; // -1 = until the end of the videos
+	int profileInterval; // 0 = only at the end (or on key 'p')
+	int camerasCnt; // 0 = all configured cameras
+
+	bool synthetic;
+	int syntheticPlayers, syntheticWidth, syntheticHeight, syntheticLength, syntheticSeed;
+
+	//=============================================================================================
+	RunOptions () : headless(false), maxFrames(-1), profileInterval(0), camerasCnt(0), synthetic(false),
+		syntheticPlayers(23), syntheticWidth(1920), syntheticHeight(1080), syntheticLength(800), syntheticSeed(1) {}
+
+	//=============================================================================================
+	static RunOptions parse (int argc, char** argv) {
+		RunOptions options;
+
+		for (int i = 1; i < argc; i++)
+		{
+			string arg = argv[i];
+
+			if (arg == "--headless")
+			{
+				options.headless = true;
+			}
+			else if (arg == "--frames" && i + 1 < argc)
+			{
+				options.maxFrames = atoi(argv[++i]);
+			}
+			else if (arg == "--profile" && i + 1 < argc)
+			{
+				options.profileInterval = atoi(argv[++i]);
+			}
+			else if (arg == "--cameras" && i + 1 < argc)
+			{
+				options.camerasCnt = atoi(argv[++i]);
+			}
+			else if (arg == "--synthetic")
+			{
+				options.synthetic = true;
+			}
+			else if (arg == "--players" && i + 1 < argc)
+			{
+				options.syntheticPlayers = atoi(argv[++i]);
+			}
+			else if (arg == "--resolution" && i + 1 < argc)
+			{
+				string res = argv[++i];
+				size_t x = res.find('x');
+				if (x != string::npos) {
+					options.syntheticWidth = atoi(res.substr(0, x).c_str());
+					options.syntheticHeight = atoi(res.substr(x + 1).c_str());
+				}
+				if (x == string::npos || options.syntheticWidth <= 0 || options.syntheticHeight <= 0) {
+					printf("resolution %s is not WxH, 1920x1080 is used\n", res.c_str());
+					options.syntheticWidth = 1920;
+					options.syntheticHeight = 1080;
+				}
+			}
+			else if (arg == "--length" && i + 1 < argc)
+			{
+				options.syntheticLength = atoi(argv[++i]);
+				if (options.syntheticLength <= 0) {
+					printf("length %d is not a number of frames, 800 is used\n", options.syntheticLength);
+					options.syntheticLength = 800;
+				}
+			}
+			else if (arg == "--seed" && i + 1 < argc)
+			{
+				options.syntheticSeed = atoi(argv[++i]);
+			}
+			else
+			{
+				printf("unknown option %s is ignored\n", arg.c_str());
+			}
+		}
+
+		return options;
+	}
+};
+
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <immintrin.h>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- CV_TM_CCORR_NORMED of a small CV_8UC3 template (up to MAX_SIZE x MAX_SIZE, the ball
+// ----- templates) without the setup matchTemplate does on every call. The template is kept as
+// ----- 16-bit rows padded to 16 values; an AVX2 kernel, instantiated for every template width so
+// ----- that the row loop has a constant length, sums image (x) template with madd for 4 positions
+// ----- at once in exact integers (below 24 * 24 * 3 * 255^2 < 2^31). The image energy under every
+// ----- position comes from the integral of the squares and the products are normalized in double,
+// ----- the values are clamped as OpenCV does. Without AVX2 (or with
+// ----- cv::setUseOptimized(false)) matchTemplate is called instead
+//*************************************************************************************************
+class SmallTemplateMatcher {
+
+	typedef void (*DotKernel)(const uchar* src, size_t srcStep, const short* templ, int templRows, int* dst, size_t dstStep, Size positions);
+
+	//_____________________________________________________________________________________________
+	public:
+
+		static const int MAX_SIZE = 24;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		Mat templ;			// CV_8UC3
+		Mat templ16;		// CV_16SC1, a row of the template per row, 16 * chunks(width) values
+		double norm;		// sqrt of the sum of squares over all channels
+		DotKernel kernel;
+
+		//=========================================================================================
+		static inline int chunks (int width) {
+			// ----- 16 bytes (5 1/3 pixels) per madd of 16-bit values -----
+			return (3 * width + 15) / 16;
+		}
+
+		//=========================================================================================
+		static inline __m256i dotChunk (const uchar* src, const short* templ, __m256i acc) {
+			__m256i image = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)src));
+			return _mm256_add_epi32(acc, _mm256_madd_epi16(image, _mm256_loadu_si256((const __m256i*)templ)));
+		}
+
+		//=========================================================================================
+		template <int W>
+		static void dot_AVX2 (const uchar* src, size_t srcStep, const short* templ, int templRows, int* dst, size_t dstStep, Size positions) {
+			// ---------- reads up to 15 bytes after the last pixel under a position (zeros in the template) ----------
+			const int K = (3 * W + 15) / 16;
+			for (int y = 0; y < positions.height; y++, src += srcStep, dst += dstStep) {
+				int x = 0;
+				for (; x + 4 <= positions.width; x += 4) {
+					__m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+					const uchar* row = src + 3 * x;
+					const short* t = templ;
+					for (int r = 0; r < templRows; r++, row += srcStep, t += 16 * K) {
+						for (int k = 0; k < K; k++) {
+							acc0 = dotChunk(row + 16 * k, t + 16 * k, acc0);
+							acc1 = dotChunk(row + 16 * k + 3, t + 16 * k, acc1);
+							acc2 = dotChunk(row + 16 * k + 6, t + 16 * k, acc2);
+							acc3 = dotChunk(row + 16 * k + 9, t + 16 * k, acc3);
+						}
+					}
+					// ----- the 4 sums side by side -----
+					__m256i h = _mm256_hadd_epi32(_mm256_hadd_epi32(acc0, acc1), _mm256_hadd_epi32(acc2, acc3));
+					__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+					_mm_storeu_si128((__m128i*)(dst + x), sum);
+				}
+				for (; x < positions.width; x++) {
+					__m256i acc = _mm256_setzero_si256();
+					const uchar* row = src + 3 * x;
+					const short* t = templ;
+					for (int r = 0; r < templRows; r++, row += srcStep, t += 16 * K) {
+						for (int k = 0; k < K; k++) {
+							acc = dotChunk(row + 16 * k, t + 16 * k, acc);
+						}
+					}
+					__m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+					sum = _mm_hadd_epi32(sum, sum);
+					sum = _mm_hadd_epi32(sum, sum);
+					dst[x] = _mm_cvtsi128_si32(sum);
+				}
+			}
+		}
+
+		//=========================================================================================
+		static DotKernel kernelFor (int width) {
+			static const DotKernel table[MAX_SIZE + 1] = { NULL,
+				dot_AVX2<1>,  dot_AVX2<2>,  dot_AVX2<3>,  dot_AVX2<4>,  dot_AVX2<5>,  dot_AVX2<6>,
+				dot_AVX2<7>,  dot_AVX2<8>,  dot_AVX2<9>,  dot_AVX2<10>, dot_AVX2<11>, dot_AVX2<12>,
+				dot_AVX2<13>, dot_AVX2<14>, dot_AVX2<15>, dot_AVX2<16>, dot_AVX2<17>, dot_AVX2<18>,
+				dot_AVX2<19>, dot_AVX2<20>, dot_AVX2<21>, dot_AVX2<22>, dot_AVX2<23>, dot_AVX2<24> };
+			return (width > 0 && width <= MAX_SIZE) ? table[width] : NULL;
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		SmallTemplateMatcher () : norm(0), kernel(NULL) {}
+
+		//=========================================================================================
+		SmallTemplateMatcher (const Mat& templ) : templ(templ), norm(0), kernel(NULL) {
+			if (!supports(templ)) return;
+			int K = chunks(templ.cols);
+			templ16 = Mat::zeros(templ.rows, 16 * K, CV_16SC1);
+			double sq = 0;
+			for (int y = 0; y < templ.rows; y++) {
+				const uchar* p = templ.ptr<uchar>(y);
+				short* t = templ16.ptr<short>(y);
+				for (int i = 0; i < 3 * templ.cols; i++) {
+					t[i] = p[i];
+					sq += double(p[i]) * p[i];
+				}
+			}
+			norm = sqrt(sq);
+			kernel = kernelFor(templ.cols);
+		}
+
+		//=========================================================================================
+		static bool supports (const Mat& templ) {
+			return templ.type() == CV_8UC3 && templ.cols <= MAX_SIZE && templ.rows <= MAX_SIZE && !templ.empty();
+		}
+
+		//=========================================================================================
+		static bool available () {
+			return useOptimized() && checkHardwareSupport(CV_CPU_AVX2);
+		}
+
+		//=========================================================================================
+		const char* kernelName () const {
+			return (kernel != NULL && available()) ? "AVX2" : "matchTemplate";
+		}
+
+		//=========================================================================================
+		void match (const Mat& src, Mat& result) const {
+			// ---------- src: CV_8UC3; result: CV_32FC1 (reused if it has the right size) ----------
+			Size positions(src.cols - templ.cols + 1, src.rows - templ.rows + 1);
+			if (kernel == NULL || !available() || positions.width <= 0 || positions.height <= 0) {
+				matchTemplate(src, templ, result, CV_TM_CCORR_NORMED);
+				return;
+			}
+			result.create(positions, CV_32FC1);
+
+			// ---------- the kernel may read 15 bytes (5 pixels) past a row: from the frame around
+			// ---------- the block if it has them, otherwise from a padded copy ----------
+			thread_local Mat padded, dots, sums, sqsums;
+			Size whole;
+			Point ofs;
+			src.locateROI(whole, ofs);
+			const uchar* data = src.data;
+			size_t step = src.step;
+			if (ofs.x + src.cols + 5 > whole.width) {
+				padded.create(src.rows, 3 * src.cols + 16, CV_8UC1);
+				for (int y = 0; y < src.rows; y++) {
+					memcpy(padded.ptr<uchar>(y), src.ptr<uchar>(y), 3 * src.cols);
+				}
+				data = padded.data;
+				step = padded.step;
+			}
+			dots.create(positions, CV_32SC1);
+			kernel(data, step, templ16.ptr<short>(), templ.rows, dots.ptr<int>(), dots.step / sizeof(int), positions);
+
+			// ---------- normalized by the energy of the image under the template ----------
+			integral(src, sums, sqsums, CV_64F, CV_64F);
+			for (int y = 0; y < positions.height; y++) {
+				const double* q0 = sqsums.ptr<double>(y);
+				const double* q1 = sqsums.ptr<double>(y + templ.rows);
+				const int* dot = dots.ptr<int>(y);
+				float* out = result.ptr<float>(y);
+				for (int x = 0; x < positions.width; x++) {
+					int l = x * 3, r = (x + templ.cols) * 3;
+					double energy = 0;
+					for (int c = 0; c < 3; c++) {
+						energy += q1[r + c] - q1[l + c] - q0[r + c] + q0[l + c];
+					}
+					double num = dot[x], den = sqrt(std::max(energy, 0.0)) * norm;
+					if (fabs(num) < den)				num /= den;
+					else if (fabs(num) < den * 1.125)	num = (num > 0) ? 1 : -1;
+					else								num = 0;
+					out[x] = float(num);
+				}
+			}
+		}
+
+		//=========================================================================================
+		~SmallTemplateMatcher (void) {}
+};
+
+}
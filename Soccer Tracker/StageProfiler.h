@@ -0,0 +1,283 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+
+#include "globalSettings.h"
+
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Merged content of several latency histograms, used for the reports only
+//*************************************************************************************************
+struct LatencySummary {
+
+	vector<uint64_t> counts;
+	uint64_t total;
+	double sum, maxValue;
+
+	//=============================================================================================
+	LatencySummary (int buckets) : counts(buckets, 0), total(0), sum(0.0), maxValue(0.0) {}
+
+	//=============================================================================================
+	double percentile (double p, double (*bucketValue)(int)) {
+		// ---------- value below which p percent of the samples are ----------
+		if (total == 0) return 0.0;
+		uint64_t rank = uint64_t(ceil(p / 100.0 * total));
+		uint64_t seen = 0;
+		for (int i = 0; i < (int)counts.size(); i++) {
+			seen += counts[i];
+			if (seen >= rank) {
+				return std::min(bucketValue(i), maxValue);
+			}
+		}
+		return maxValue;
+	}
+};
+
+//*************************************************************************************************
+// ----- Histogram of latencies in microseconds with logarithmic buckets (8 per power of two,
+// ----- so percentiles are known within ~6 %). Only its owner-thread writes to it, relaxed
+// ----- atomics let the report read it meanwhile without slowing the writer down
+//*************************************************************************************************
+class LatencyHistogram {
+
+	//_____________________________________________________________________________________________
+	public:
+
+		static const int SUB_BUCKETS = 8;
+		static const int BUCKETS = 32 * SUB_BUCKETS; // up to 2^32 us
+
+	//_____________________________________________________________________________________________
+	private:
+
+		atomic<uint32_t> counts[BUCKETS];
+		atomic<uint32_t> total;
+		atomic<double> sum, maxValue;
+
+		//=========================================================================================
+		template <typename T>
+		static void add (atomic<T>& a, T value) {
+			// ----- single writer: no need for an atomic read-modify-write -----
+			a.store(a.load(memory_order_relaxed) + value, memory_order_relaxed);
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		LatencyHistogram () {
+			for (int i = 0; i < BUCKETS; i++) {
+				counts[i] = 0;
+			}
+			total = 0;
+			sum = 0.0;
+			maxValue = 0.0;
+		}
+
+		//=========================================================================================
+		static int bucketOf (double value) {
+			if (value < 1.0) return 0;
+			int exponent;
+			double mantissa = frexp(value, &exponent); // value = mantissa * 2^exponent, mantissa in [0.5, 1)
+			int idx = (exponent - 1) * SUB_BUCKETS + int((mantissa * 2.0 - 1.0) * SUB_BUCKETS);
+			return std::min(idx, BUCKETS - 1);
+		}
+
+		//=========================================================================================
+		static double bucketValue (int idx) {
+			// ----- upper bound of the bucket -----
+			int exponent = idx / SUB_BUCKETS;
+			return ldexp(1.0 + double(idx % SUB_BUCKETS + 1) / SUB_BUCKETS, exponent);
+		}
+
+		//=========================================================================================
+		void record (double value) {
+			add<uint32_t>(counts[bucketOf(value)], 1);
+			add<uint32_t>(total, 1);
+			add<double>(sum, value);
+			if (value > maxValue.load(memory_order_relaxed)) {
+				maxValue.store(value, memory_order_relaxed);
+			}
+		}
+
+		//=========================================================================================
+		bool empty () {
+			return total.load(memory_order_relaxed) == 0;
+		}
+
+		//=========================================================================================
+		void mergeInto (LatencySummary& summary) {
+			for (int i = 0; i < BUCKETS; i++) {
+				summary.counts[i] += counts[i].load(memory_order_relaxed);
+			}
+			summary.total += total.load(memory_order_relaxed);
+			summary.sum += sum.load(memory_order_relaxed);
+			summary.maxValue = std::max(summary.maxValue, maxValue.load(memory_order_relaxed));
+		}
+};
+
+//*************************************************************************************************
+// ----- Collects the latency of every stage of the pipeline per camera (and of the fusion).
+// ----- Every thread records into its own set of histograms, they are merged only when
+// ----- the report is made, so recording takes no lock. The report is printed on demand
+// ----- and at the end of the run, it does not reset the histograms
+//*************************************************************************************************
+class StageProfiler {
+
+	typedef chrono::steady_clock Clock;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		static const int MAX_CAMERAS = 8;
+		static const int FUSION = -1; // camera index of the fusion stages
+
+	//_____________________________________________________________________________________________
+	private:
+
+		struct ThreadHistograms {
+			LatencyHistogram hist[MAX_CAMERAS + 1][PROFILE_STAGES_COUNT]; // the last row is the fusion
+		};
+
+		mutex mtx;
+		vector<unique_ptr<ThreadHistograms>> threads;
+		Clock::time_point created;
+
+		//=========================================================================================
+		StageProfiler () {
+			created = Clock::now();
+		}
+
+		//=========================================================================================
+		static StageProfiler& instance () {
+			static StageProfiler profiler;
+			return profiler;
+		}
+
+		//=========================================================================================
+		ThreadHistograms& local () {
+			// ----- histograms of the calling thread, they are owned by the profiler and outlive the thread -----
+			thread_local ThreadHistograms* own = NULL;
+			if (own == NULL) {
+				lock_guard<mutex> lock(mtx);
+				threads.push_back(unique_ptr<ThreadHistograms>(new ThreadHistograms()));
+				own = threads.back().get();
+			}
+			return *own;
+		}
+
+		//=========================================================================================
+		static const char* stageName (int stage) {
+			static const char* names[PROFILE_STAGES_COUNT] = {
+				"decode", "resize/flip", "decode wait", "normalizeImage", "smoothImage", "HistMethod",
+				"contours", "trackPlayers", "trackBall", "drawing", "barrier wait",
+				"updateTrackData", "identifyTruePositive", "compute3D_Coords", "cameraHandoff", "finalizeResults"
+			};
+			return names[stage];
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		static void record (int camera, PROFILE_STAGE stage, double microseconds) {
+			#ifdef PROFILE_STAGES
+			int row = (camera < 0 || camera >= MAX_CAMERAS) ? MAX_CAMERAS : camera;
+			instance().local().hist[row][stage].record(microseconds);
+			#endif
+		}
+
+		//=========================================================================================
+		static string toString () {
+			// ---------- p50/p95/p99 of every stage that was recorded, in milliseconds ----------
+			StageProfiler& profiler = instance();
+			lock_guard<mutex> lock(profiler.mtx);
+
+			double upTime = chrono::duration<double>(Clock::now() - profiler.created).count();
+			string result;
+			char line[256];
+			snprintf(line, sizeof(line), "stage latency after %.1f s [ms]:\n%-28s %8s %9s %9s %9s %9s %9s\n",
+				upTime, "", "count", "mean", "p50", "p95", "p99", "max");
+			result += line;
+
+			for (int row = 0; row <= MAX_CAMERAS; row++) {
+				for (int stage = 0; stage < PROFILE_STAGES_COUNT; stage++) {
+					LatencySummary summary(LatencyHistogram::BUCKETS);
+					for (auto& thread : profiler.threads) {
+						thread->hist[row][stage].mergeInto(summary);
+					}
+					if (summary.total == 0) continue;
+
+					string label = (row == MAX_CAMERAS) ? "fusion" : "camera " + to_string(row);
+					label += " " + string(stageName(stage));
+					snprintf(line, sizeof(line), "%-28s %8llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", label.c_str(),
+						(unsigned long long)summary.total, summary.sum / summary.total / 1000.0,
+						summary.percentile(50, LatencyHistogram::bucketValue) / 1000.0,
+						summary.percentile(95, LatencyHistogram::bucketValue) / 1000.0,
+						summary.percentile(99, LatencyHistogram::bucketValue) / 1000.0,
+						summary.maxValue / 1000.0);
+					result += line;
+				}
+			}
+			return result;
+		}
+
+		//=========================================================================================
+		static void printReport () {
+			printf("%s", toString().c_str());
+			fflush(stdout);
+		}
+};
+
+//*************************************************************************************************
+// ----- Measures the time from its construction until stop() or the end of the scope
+//*************************************************************************************************
+class StageTimer {
+
+	typedef chrono::steady_clock Clock;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		int camera;
+		PROFILE_STAGE stage;
+		bool running;
+		Clock::time_point tic;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		StageTimer (int camera, PROFILE_STAGE stage) : camera(camera), stage(stage), running(true) {
+			#ifdef PROFILE_STAGES
+			tic = Clock::now();
+			#endif
+		}
+
+		//=========================================================================================
+		void stop () {
+			if (!running) return;
+			running = false;
+			#ifdef PROFILE_STAGES
+			StageProfiler::record(camera, stage, chrono::duration<double, micro>(Clock::now() - tic).count());
+			#endif
+		}
+
+		//=========================================================================================
+		~StageTimer (void) {
+			stop();
+		}
+};
+
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+
+#include "Configurator.h"
+#include "globalSettings.h"
+
+using namespace cv;
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- This class renders a synthetic match for the calibrated cameras: a green pitch with
+// ----- player blobs and a ball passed between them, seen through the homography of every camera.
+// ----- It writes one video and one ground truth file (the same format as the ISSIA ones)
+// ----- per camera, so the tracking can be run and measured without the real dataset.
+// ----- The whole scene is driven by one seeded RNG, every run with the same options is identical
+//*************************************************************************************************
+class SyntheticScene {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		struct SceneCamera {
+			int idx;
+			Point3d camCoords;
+			Mat viewToModel; // output pixel -> field model pixel
+			Mat modelToView; // field model pixel -> view pixel (1920 x 1080)
+			bool projHFlip, viewHFlip;
+			Mat background;
+			vector<pair<int, Point>> groundTruth;
+		};
+
+		struct Player {
+			Point2d pos, target;
+			double speed;
+			int team;
+		};
+
+		// ----- field model: 105 x 68 m mapped to 1920 x 1080 pixels (MODEL_METERS_PER_PX_X/Y) -----
+		const double FIELD_W = 105.0, FIELD_H = 68.0;
+		const double BALL_RADIUS = 0.11, PLAYER_HEIGHT = 1.8;
+
+		Configurator* configurator;
+		Size resolution;
+		RNG rng;
+		Mat fieldModel;
+		vector<SceneCamera> cameras;
+		vector<Player> players;
+
+		// ----- ball: held by a player or flying from flightFrom to flightTo -----
+		Point3d ball;
+		int holder, receiver, holdFrames, flightFrame, flightFrames;
+		Point2d flightFrom, flightTo;
+		double flightPeak;
+
+		//=========================================================================================
+		Point modelPx (double x, double y) {
+			return Point(int(x / MODEL_METERS_PER_PX_X), int(y / MODEL_METERS_PER_PX_Y));
+		}
+
+		//=========================================================================================
+		void drawFieldModel () {
+			// ---------- top view of the pitch, also used as the field model of the fusion ----------
+			fieldModel = Mat(1080, 1920, CV_8UC3);
+			for (int i = 0; i < 12; i++) {
+				Scalar stripe = (i % 2 == 0) ? Scalar(58, 104, 80) : Scalar(68, 94, 88);
+				rectangle(fieldModel, Rect(i * 160, 0, 160, 1080), stripe, -1);
+			}
+
+			Scalar white(235, 235, 235);
+			int t = 3;
+			rectangle(fieldModel, modelPx(0.1, 0.1), modelPx(FIELD_W - 0.1, FIELD_H - 0.1), white, t);
+			line(fieldModel, modelPx(FIELD_W / 2, 0), modelPx(FIELD_W / 2, FIELD_H), white, t);
+			ellipse(fieldModel, modelPx(FIELD_W / 2, FIELD_H / 2), Size(int(9.15 / MODEL_METERS_PER_PX_X), int(9.15 / MODEL_METERS_PER_PX_Y)), 0, 0, 360, white, t);
+			circle(fieldModel, modelPx(FIELD_W / 2, FIELD_H / 2), 4, white, -1);
+
+			for (int side = 0; side < 2; side++) {
+				double x0 = (side == 0) ? 0.0 : FIELD_W;
+				double dir = (side == 0) ? 1.0 : -1.0;
+				rectangle(fieldModel, modelPx(x0, FIELD_H / 2 - 20.16), modelPx(x0 + dir * 16.5, FIELD_H / 2 + 20.16), white, t);
+				rectangle(fieldModel, modelPx(x0, FIELD_H / 2 - 9.16), modelPx(x0 + dir * 5.5, FIELD_H / 2 + 9.16), white, t);
+				circle(fieldModel, modelPx(x0 + dir * 11.0, FIELD_H / 2), 4, white, -1);
+			}
+		}
+
+		//=========================================================================================
+		bool project (SceneCamera& cam, Point3d p, Point2d& view) {
+			// ---------- 3D point (meters) -> view pixel: the ray from the camera is cut by the ground plane ----------
+			if (p.z >= cam.camCoords.z) return false;
+			double t = cam.camCoords.z / (cam.camCoords.z - p.z);
+			Point3d g = cam.camCoords + t * (p - cam.camCoords);
+
+			vector<Point2d> src(1, Point2d(g.x / MODEL_METERS_PER_PX_X, g.y / MODEL_METERS_PER_PX_Y)), dst;
+			perspectiveTransform(src, dst, cam.modelToView);
+			view = dst[0];
+			if (cam.projHFlip) view.x = 1920 - view.x;
+
+			// ----- points far away from the view are behind the camera or not seen at all -----
+			return (view.x > -1920 && view.x < 2 * 1920 && view.y > -1080 && view.y < 2 * 1080);
+		}
+
+		//=========================================================================================
+		void initPlayers (int playersCnt) {
+			// ---------- two teams spread over their halves and one referee ----------
+			players.clear();
+			for (int i = 0; i < playersCnt; i++) {
+				Player p;
+				p.team = (i == playersCnt - 1 && playersCnt > 2) ? 2 : i % 2;
+				double xMin = (p.team == 0) ? 5.0 : (p.team == 1) ? FIELD_W / 2 : 20.0;
+				double xMax = (p.team == 0) ? FIELD_W / 2 : (p.team == 1) ? FIELD_W - 5.0 : FIELD_W - 20.0;
+				p.pos = Point2d(rng.uniform(xMin, xMax), rng.uniform(3.0, FIELD_H - 3.0));
+				p.target = p.pos;
+				p.speed = 0;
+				players.push_back(p);
+			}
+		}
+
+		//=========================================================================================
+		void movePlayers (double dt) {
+			for (unsigned i = 0; i < players.size(); i++) {
+				Player& p = players[i];
+				Point2d d = p.target - p.pos;
+				double dist = norm(d);
+				if (dist < 0.5) {
+					// ----- new run: somewhere around the current position -----
+					p.target.x = std::min(std::max(p.pos.x + rng.uniform(-15.0, 15.0), 1.0), FIELD_W - 1.0);
+					p.target.y = std::min(std::max(p.pos.y + rng.uniform(-12.0, 12.0), 1.0), FIELD_H - 1.0);
+					p.speed = rng.uniform(1.0, 6.5);
+					continue;
+				}
+				p.pos += d * std::min(p.speed * dt / dist, 1.0);
+			}
+		}
+
+		//=========================================================================================
+		void moveBall () {
+			if (players.size() < 2) {
+				ball = Point3d(FIELD_W / 2, FIELD_H / 2, 0);
+				return;
+			}
+
+			if (holder >= 0) {
+				// ----- at the feet of the holder, then passed to a random team mate (or lost to anyone) -----
+				Player& p = players[holder];
+				Point2d heading = p.target - p.pos;
+				double len = norm(heading);
+				Point2d feet = p.pos + ((len > 0) ? heading * (0.4 / len) : Point2d(0.4, 0));
+				ball = Point3d(feet.x, feet.y, BALL_RADIUS);
+
+				if (--holdFrames > 0) return;
+
+				do {
+					receiver = rng.uniform(0, int(players.size()));
+				} while (receiver == holder || (players[receiver].team == 2));
+
+				flightFrom = feet;
+				flightTo = players[receiver].pos;
+				double speed = rng.uniform(10.0, 25.0);
+				flightFrames = std::max(int(norm(flightTo - flightFrom) / speed * OUT_FRAME_RATE), 1);
+				flightPeak = (rng.uniform(0.0, 1.0) < 0.3) ? rng.uniform(2.0, 8.0) : 0.0;
+				flightFrame = 0;
+				holder = -1;
+
+				// ----- the receiver runs to meet the ball -----
+				players[receiver].target = flightTo;
+				players[receiver].speed = 2.0;
+			}
+
+			flightFrame++;
+			double s = double(flightFrame) / flightFrames;
+			Point2d g = flightFrom + (flightTo - flightFrom) * s;
+			ball = Point3d(g.x, g.y, BALL_RADIUS + 4 * flightPeak * s * (1 - s));
+
+			if (flightFrame >= flightFrames) {
+				holder = receiver;
+				holdFrames = rng.uniform(10, 40);
+			}
+		}
+
+		//=========================================================================================
+		void renderFrame (SceneCamera& cam, Mat& frame) {
+			// ---------- players and ball drawn over the static pitch, far objects first ----------
+			frame = cam.background.clone();
+			double sx = resolution.width / 1920.0, sy = resolution.height / 1080.0;
+
+			vector<pair<double, int>> order; // distance to the camera, object (-1 = ball)
+			Point2d camGround(cam.camCoords.x, cam.camCoords.y);
+			for (unsigned i = 0; i < players.size(); i++) {
+				order.push_back(make_pair(norm(players[i].pos - camGround), int(i)));
+			}
+			order.push_back(make_pair(norm(Point2d(ball.x, ball.y) - camGround), -1));
+			sort(order.begin(), order.end(), [](const pair<double, int>& a, const pair<double, int>& b) { return a.first > b.first; });
+
+			static const Scalar shirts[3] = { Scalar(40, 40, 200), Scalar(210, 170, 60), Scalar(20, 20, 20) };
+			static const Scalar shorts[3] = { Scalar(230, 230, 230), Scalar(60, 30, 20), Scalar(20, 20, 20) };
+
+			for (auto& o : order) {
+				if (o.second == -1) {
+					Point2d c, top;
+					if (!project(cam, ball, c) || !project(cam, ball + Point3d(0, 0, 2 * BALL_RADIUS), top)) continue;
+					int rad = std::max(int(norm(top - c) * sy / 2), 2);
+					circle(frame, Point(int(c.x * sx), int(c.y * sy)), rad, Scalar(240, 240, 240), -1, LINE_AA);
+					continue;
+				}
+
+				Player& p = players[o.second];
+				Point2d foot, head;
+				if (!project(cam, Point3d(p.pos.x, p.pos.y, 0), foot) || !project(cam, Point3d(p.pos.x, p.pos.y, PLAYER_HEIGHT), head)) continue;
+				foot = Point2d(foot.x * sx, foot.y * sy);
+				head = Point2d(head.x * sx, head.y * sy);
+
+				double h = norm(foot - head);
+				if (h < 3) continue;
+				int w = std::max(int(h * 0.15), 1);
+				Point2d hip = foot + (head - foot) * 0.45, neck = foot + (head - foot) * 0.85;
+
+				line(frame, foot, hip, Scalar(30, 30, 30), w, LINE_AA);
+				ellipse(frame, (hip + neck) * 0.5, Size(w + 1, std::max(int(norm(neck - hip) / 2), 1)), 0, 0, 360, shirts[p.team], -1, LINE_AA);
+				ellipse(frame, hip, Size(w + 1, std::max(int(h * 0.08), 1)), 0, 0, 360, shorts[p.team], -1, LINE_AA);
+				circle(frame, neck + (head - neck) * 0.5, std::max(int(h * 0.07), 1), Scalar(120, 150, 200), -1, LINE_AA);
+			}
+		}
+
+		//=========================================================================================
+		void writeGroundTruth (string fileName, vector<pair<int, Point>>& positions, int frames) {
+			// ---------- ViPER file with the ball positions only (all the tracker reads) ----------
+			ofstream file(fileName);
+			file << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+			file << "<viper xmlns=\"http://lamp.cfar.umd.edu/viper#\" xmlns:data=\"http://lamp.cfar.umd.edu/viperdata#\">\n";
+			file << "    <data>\n";
+			file << "        <sourcefile filename=\"synthetic\">\n";
+			file << "            <object framespan=\"0:" << frames - 1 << "\" id=\"0\" name=\"BALL\">\n";
+			file << "                <attribute name=\"BallPos\">\n";
+			for (auto& p : positions) {
+				file << "                    <data:point framespan=\"" << p.first << ":" << p.first << "\" x=\"" << p.second.x << "\" y=\"" << p.second.y << "\"/>\n";
+			}
+			file << "                </attribute>\n";
+			file << "            </object>\n";
+			file << "        </sourcefile>\n";
+			file << "    </data>\n";
+			file << "</viper>\n";
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		SyntheticScene (Configurator* configurator, Size resolution, int playersCnt, int seed) : rng(uint64(seed)) {
+			this->configurator = configurator;
+			this->resolution = resolution;
+			drawFieldModel();
+			initPlayers(playersCnt);
+			holder = players.empty() ? -1 : 0;
+			receiver = holder;
+			holdFrames = 1;
+			ball = Point3d(FIELD_W / 2, FIELD_H / 2, BALL_RADIUS);
+		}
+
+		//=========================================================================================
+		void addCamera (int idx, Point3d camCoords) {
+			// ---------- the same calibration the tracking of camera idx uses ----------
+			SceneCamera cam;
+			cam.idx = idx;
+			cam.camCoords = camCoords;
+			cam.projHFlip = configurator->readObject<bool>("projHFlip" + to_string(idx));
+			cam.viewHFlip = configurator->readObject<bool>("viewHFlip" + to_string(idx));
+
+			Mat homography = configurator->readObject<Mat>("homography" + to_string(idx));
+			homography.convertTo(homography, CV_64F);
+			cam.modelToView = homography.inv();
+
+			// ----- output pixel -> view pixel (1920 x 1080) -> projection flip -> field model -----
+			Mat scale = (Mat_<double>(3, 3) << 1920.0 / resolution.width, 0, 0, 0, 1080.0 / resolution.height, 0, 0, 0, 1);
+			Mat flipM = cam.projHFlip ? (Mat_<double>(3, 3) << -1, 0, 1920, 0, 1, 0, 0, 0, 1) : Mat::eye(3, 3, CV_64F);
+			cam.viewToModel = homography * flipM * scale;
+
+			// ----- cameras do not move: the pitch is warped only once -----
+			warpPerspective(fieldModel, cam.background, cam.viewToModel, resolution, INTER_LINEAR | WARP_INVERSE_MAP, BORDER_CONSTANT, Scalar(70, 60, 55));
+
+			cameras.push_back(cam);
+		}
+
+		//=========================================================================================
+		Mat getFieldModel () {
+			return fieldModel;
+		}
+
+		//=========================================================================================
+		void render (string folder, int frames, int fps) {
+			// ---------- writes <folder><idx>.avi and <folder>ground_truth_<idx>.xgtf for every camera ----------
+			vector<cv::VideoWriter> writers(cameras.size());
+			for (unsigned i = 0; i < cameras.size(); i++) {
+				writers[i].open(folder + to_string(cameras[i].idx) + ".avi", CV_FOURCC('M', 'J', 'P', 'G'), fps, resolution);
+				cameras[i].groundTruth.clear();
+			}
+
+			Mat frame;
+			for (int f = 0; f < frames; f++) {
+				movePlayers(1.0 / fps);
+				moveBall();
+
+				for (unsigned i = 0; i < cameras.size(); i++) {
+					SceneCamera& cam = cameras[i];
+					renderFrame(cam, frame);
+
+					Point2d view;
+					if (project(cam, ball, view) && Rect(0, 0, 1920, 1080).contains(Point(view))) {
+						// ----- ground truth of the even cameras is stored mirrored, as in the ISSIA files -----
+						int x = (cam.idx % 2 == 0) ? 1920 - int(view.x) : int(view.x);
+						cam.groundTruth.push_back(make_pair(f, Point(x, int(view.y))));
+					}
+
+					// ----- stored the way the camera delivers it, the reader flips it back -----
+					if (cam.viewHFlip) flip(frame, frame, 1);
+					writers[i] << frame;
+				}
+
+				if (f % 100 == 0) {
+					printf("synthetic scene: frame %d / %d\n", f, frames); fflush(stdout);
+				}
+			}
+
+			for (unsigned i = 0; i < cameras.size(); i++) {
+				writers[i].release();
+				writeGroundTruth(folder + "ground_truth_" + to_string(cameras[i].idx) + ".xgtf", cameras[i].groundTruth, frames);
+			}
+		}
+
+		//=========================================================================================
+		~SyntheticScene (void) {}
+};
+
+}
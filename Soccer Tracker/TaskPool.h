@@ -0,0 +1,249 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Work-stealing pool of worker threads. Every worker owns a deque: it takes its own tasks
+// ----- from the back (the most recently spawned, still hot in cache) and steals from the front
+// ----- of other workers' deques when it runs out of work. Tasks spawned by a worker go to its
+// ----- own deque, tasks spawned by other threads are distributed round-robin
+//*************************************************************************************************
+class TaskPool {
+
+	typedef function<void()> Task;
+
+	//_____________________________________________________________________________________________
+	private:
+
+		struct WorkQueue {
+			mutex mtx;
+			deque<Task> tasks;
+		};
+
+		vector<unique_ptr<WorkQueue>> queues;
+		vector<thread> workers;
+
+		mutex sleepMtx;
+		condition_variable sleepCV;
+		atomic<int> pending, nextQueue;
+		atomic<bool> stopping;
+
+		//=========================================================================================
+		static int& workerIdx () {
+			// ----- index of the calling worker thread, -1 for threads that do not belong to the pool -----
+			thread_local int idx = -1;
+			return idx;
+		}
+
+		//=========================================================================================
+		bool popTask (int idx, Task& task) {
+			// ---------- own deque first (LIFO), then steal from the others (FIFO) ----------
+			int queuesCnt = int(queues.size());
+			if (idx >= 0) {
+				WorkQueue& own = *queues[idx];
+				lock_guard<mutex> lock(own.mtx);
+				if (!own.tasks.empty()) {
+					task = move(own.tasks.back());
+					own.tasks.pop_back();
+					pending--;
+					return true;
+				}
+			}
+			int start = (idx >= 0) ? idx + 1 : 0;
+			for (int i = 0; i < queuesCnt; i++) {
+				WorkQueue& victim = *queues[(start + i) % queuesCnt];
+				lock_guard<mutex> lock(victim.mtx);
+				if (!victim.tasks.empty()) {
+					task = move(victim.tasks.front());
+					victim.tasks.pop_front();
+					pending--;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//=========================================================================================
+		void workerLoop (int idx) {
+			workerIdx() = idx;
+			while (true) {
+				Task task;
+				if (popTask(idx, task)) {
+					task();
+					continue;
+				}
+				unique_lock<mutex> lock(sleepMtx);
+				sleepCV.wait(lock, [&] { return (pending > 0) || stopping; });
+				if (stopping && pending == 0) {
+					return;
+				}
+			}
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		TaskPool (int threadsCnt = 0) {
+			// ----- by default one worker less than cores: a thread waiting for a group runs its tasks as well -----
+			if (threadsCnt <= 0) {
+				threadsCnt = std::max(int(thread::hardware_concurrency()) - 1, 1);
+			}
+			pending = 0;
+			nextQueue = 0;
+			stopping = false;
+
+			for (int i = 0; i < threadsCnt; i++) {
+				queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+			}
+			for (int i = 0; i < threadsCnt; i++) {
+				workers.push_back(thread(&TaskPool::workerLoop, this, i));
+			}
+		}
+
+		//=========================================================================================
+		int getThreadsCnt () {
+			return int(workers.size());
+		}
+
+		//=========================================================================================
+		void submit (Task task) {
+			int idx = workerIdx();
+			if (idx < 0) {
+				idx = nextQueue++ % int(queues.size());
+			}
+			{
+				lock_guard<mutex> lock(queues[idx]->mtx);
+				queues[idx]->tasks.push_back(move(task));
+				pending++;
+			}
+			{
+				// ----- taking the lock makes sure a worker going to sleep sees the new task -----
+				lock_guard<mutex> lock(sleepMtx);
+			}
+			sleepCV.notify_one();
+		}
+
+		//=========================================================================================
+		~TaskPool (void) {
+			{
+				lock_guard<mutex> lock(sleepMtx);
+				stopping = true;
+			}
+			sleepCV.notify_all();
+			for (auto& w : workers) {
+				w.join();
+			}
+		}
+};
+
+//*************************************************************************************************
+// ----- A set of tasks the caller waits for. Every task is claimed once, by a worker or by the
+// ----- waiter: while waiting the caller runs the tasks of this group nobody has started yet (never
+// ----- the ones of other groups, which could be a whole camera stage), then sleeps until the last
+// ----- running one signals. A wait always progresses: whatever is left is running elsewhere
+//*************************************************************************************************
+class TaskGroup {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		struct GroupTask {
+			function<void()> body;
+			atomic<bool> claimed;
+			GroupTask (function<void()> body) : body(body), claimed(false) {}
+		};
+
+		TaskPool* pool;
+		vector<shared_ptr<GroupTask>> tasks; // used by the owner thread only (run, wait)
+		atomic<int> remaining;
+		mutex mtx;
+		condition_variable doneCV;
+
+		//=========================================================================================
+		void execute (GroupTask& task) {
+			task.body();
+			lock_guard<mutex> lock(mtx);
+			if (--remaining == 0) {
+				doneCV.notify_all();
+			}
+		}
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		TaskGroup (TaskPool* pool) : pool(pool) {
+			remaining = 0;
+		}
+
+		//=========================================================================================
+		void run (function<void()> task) {
+			if (pool == NULL) {
+				task();
+				return;
+			}
+			shared_ptr<GroupTask> item = make_shared<GroupTask>(task);
+			tasks.push_back(item);
+			remaining++;
+			pool->submit([this, item] {
+				// ----- a task the waiter already ran is a no-op (the group may be gone by then) -----
+				if (!item->claimed.exchange(true)) {
+					execute(*item);
+				}
+			});
+		}
+
+		//=========================================================================================
+		void wait () {
+			for (auto& item : tasks) {
+				if (!item->claimed.exchange(true)) {
+					execute(*item);
+				}
+			}
+			tasks.clear();
+			// ----- the rest is running on other threads; the last one notifies under the mutex,
+			// ----- so the group is not destroyed before it leaves -----
+			unique_lock<mutex> lock(mtx);
+			doneCV.wait(lock, [&] { return remaining == 0; });
+		}
+
+		//=========================================================================================
+		~TaskGroup (void) {
+			if (pool != NULL) {
+				wait();
+			}
+		}
+};
+
+//=================================================================================================
+inline void parallelFor (TaskPool* pool, int count, function<void(int)> body) {
+	// ---------- runs body(0..count-1) on the pool, sequentially when there is no pool or one item ----------
+	if (pool == NULL || count < 2) {
+		for (int i = 0; i < count; i++) {
+			body(i);
+		}
+		return;
+	}
+	TaskGroup group(pool);
+	for (int i = 1; i < count; i++) {
+		group.run([&body, i] { body(i); });
+	}
+	body(0);
+	group.wait();
+}
+
+}
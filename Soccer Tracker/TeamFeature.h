@@ -0,0 +1,163 @@
+#pragma once
+
+#include <opencv/cv.h>
+#include <emmintrin.h>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include "globalSettings.h"
+
+using namespace cv;
+
+namespace st {
+
+//*************************************************************************************************
+// ----- Colour signature of a player: histogram of the quantized chromaticity (r and g, 4 levels
+// ----- each) and brightness (2 levels) of the foreground pixels of the rectangle, normalized to
+// ----- sum 1. 32 floats, compared by L2 distance in SSE
+//*************************************************************************************************
+class TeamFeature {
+
+	//_____________________________________________________________________________________________
+	public:
+
+		static const int BINS = 32;
+
+		//=========================================================================================
+		static void compute (const Mat& bgr, const Mat& mask, float* feature) {
+			// ---------- bgr: CV_8UC3; mask: CV_8UC1 of the same size, non-zero on the player
+			// ---------- (empty: every pixel) ----------
+			int hist[BINS] = { 0 };
+			int count = 0;
+			for (int y = 0; y < bgr.rows; y++) {
+				const uchar* p = bgr.ptr<uchar>(y);
+				const uchar* m = mask.empty() ? NULL : mask.ptr<uchar>(y);
+				for (int x = 0; x < bgr.cols; x++, p += 3) {
+					if (m != NULL && m[x] == 0) continue;
+					int b = p[0], g = p[1], r = p[2];
+
+					// ----- 4 * r / (sum + 1) is below 4 for every pixel -----
+					int sum = b + g + r;
+					int rc = 4 * r / (sum + 1);
+					int gc = 4 * g / (sum + 1);
+					int light = (sum > 3 * 128) ? 1 : 0;
+					hist[(rc * 4 + gc) * 2 + light]++;
+					count++;
+				}
+			}
+			float scale = (count > 0) ? 1.0f / count : 0.0f;
+			for (int i = 0; i < BINS; i++) {
+				feature[i] = hist[i] * scale;
+			}
+		}
+
+		//=========================================================================================
+		static float distance (const float* a, const float* b) {
+			__m128 acc = _mm_setzero_ps();
+			for (int i = 0; i < BINS; i += 4) {
+				__m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+				acc = _mm_add_ps(acc, _mm_mul_ps(d, d));
+			}
+			acc = _mm_add_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 0, 3, 2)));
+			acc = _mm_add_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1)));
+			return sqrt(_mm_cvtss_f32(acc));
+		}
+};
+
+//*************************************************************************************************
+// ----- Prototypes of the teams (A, B, referee) in the compact feature, made from the frames of one
+// ----- camera: the mean of the features of single player crops the classifier labelled with a
+// ----- clear margin. Once every team has enough samples the features are labelled by the nearest
+// ----- prototype; the first labels are compared with the classifier, the agreement is kept per team
+//*************************************************************************************************
+class TeamPrototypes {
+
+	//_____________________________________________________________________________________________
+	private:
+
+		double sum[3][TeamFeature::BINS];
+		float prototype[3][TeamFeature::BINS];
+		int samples[3], agreed[3], compared[3];
+		int needed, checks, checked;
+		bool isReady;
+
+	//_____________________________________________________________________________________________
+	public:
+
+		//=========================================================================================
+		TeamPrototypes (int needed = TEAM_CALIBRATION_SAMPLES, int checks = TEAM_AGREEMENT_CHECKS) : needed(needed), checks(checks), checked(0), isReady(false) {
+			for (int t = 0; t < 3; t++) {
+				samples[t] = agreed[t] = compared[t] = 0;
+				for (int i = 0; i < TeamFeature::BINS; i++) sum[t][i] = 0.0;
+			}
+		}
+
+		//=========================================================================================
+		bool ready () {
+			return isReady;
+		}
+
+		//=========================================================================================
+		void addSample (int team, const float* feature) {
+			if (isReady || team < 0 || team >= 3) return;
+			for (int i = 0; i < TeamFeature::BINS; i++) sum[team][i] += feature[i];
+			samples[team]++;
+
+			// ----- the prototypes are fixed once the last team has its samples -----
+			if (samples[0] >= needed && samples[1] >= needed && samples[2] >= needed) {
+				for (int t = 0; t < 3; t++) {
+					for (int i = 0; i < TeamFeature::BINS; i++) prototype[t][i] = float(sum[t][i] / samples[t]);
+				}
+				isReady = true;
+			}
+		}
+
+		//=========================================================================================
+		int classify (const float* feature, double& confidence) {
+			// ---------- nearest prototype; confidence is the margin to the second nearest one
+			// ---------- (0: undecided, 1: only one fits) ----------
+			float dist[3];
+			for (int t = 0; t < 3; t++) {
+				dist[t] = TeamFeature::distance(feature, prototype[t]);
+			}
+			int best = int(std::min_element(dist, dist + 3) - dist);
+			float second = FLT_MAX;
+			for (int t = 0; t < 3; t++) {
+				if (t != best) second = std::min(second, dist[t]);
+			}
+			confidence = (second > 0) ? (second - dist[best]) / second : 0.0;
+			return best;
+		}
+
+		//=========================================================================================
+		bool comparing () {
+			return isReady && checked < checks;
+		}
+
+		//=========================================================================================
+		void compare (int team, int classifierTeam) {
+			if (classifierTeam < 0 || classifierTeam >= 3) return;
+			compared[classifierTeam]++;
+			if (team == classifierTeam) agreed[classifierTeam]++;
+			checked++;
+		}
+
+		//=========================================================================================
+		int getSamples (int team) {
+			return samples[team];
+		}
+
+		//=========================================================================================
+		int getCompared (int team) {
+			return compared[team];
+		}
+
+		//=========================================================================================
+		double getAgreement (int team) {
+			// ----- share of the crops of the classifier's team that got the same label -----
+			return (compared[team] > 0) ? double(agreed[team]) / compared[team] : 0.0;
+		}
+};
+
+}
@@ -28,19 +28,22 @@ class TemplateGenerator {
 		//}
 
 		//=========================================================================================
-		static Mat createBallTemple (int rad = 4, int border = 1, Scalar backGrColor = CV_RGB(50,128,50)) {
+		static Mat createBallTemple (double rad = 4, int border = 1, Scalar backGrColor = CV_RGB(50,128,50)) {
+			// ----- rad may be fractional: the ball is drawn 10 times larger, the size is the one of ceil(rad) -----
 			int iniScaleCoeff = 10;
-			int expRad = rad * iniScaleCoeff;
+			int cellRad = int(ceil(rad - 1e-6));
+			int expRad = cvRound(rad * iniScaleCoeff);
 			int expBorder = border * iniScaleCoeff;
-			int templSize = 2 * (expRad + expBorder) + 1;
-			Point center(expRad + expBorder, expRad + expBorder);
+			int expCell = cellRad * iniScaleCoeff + expBorder;
+			int templSize = 2 * expCell + 1;
+			Point center(expCell, expCell);
 			Mat templ(templSize, templSize, CV_8UC3, backGrColor);
 			circle(templ, center, expRad, CV_RGB(255,255,255), -1);
-			int blurRad = rad;
+			int blurRad = std::max(cvRound(rad), 1);
 			Size kernelSize(2 * blurRad + 1, 2 * blurRad + 1);
 			double sigma = double(blurRad) / 3;
 			GaussianBlur(templ, templ, kernelSize, sigma);
-			Size finalSize(2 * rad + 1 + border, 2 * rad + 1 + border);
+			Size finalSize(2 * cellRad + 1 + border, 2 * cellRad + 1 + border);
 			resize(templ, templ, finalSize, 0, 0, CV_INTER_AREA);
 			return templ;
 		}
@@ -7,6 +7,20 @@
 
 namespace st {
 
+//*************************************************************************************************
+// ----- Copy of the player state the handler-thread needs. Camera-threads keep modifying
+// ----- (and deleting) their PlayerCandidates while the previous frame is being fused
+//*************************************************************************************************
+struct PlayerInfo {
+
+	int id, teamID;
+	Point curCrd;
+	Rect curRect;
+
+	//=============================================================================================
+	PlayerInfo (PlayerCandidate* pc) : id(pc->id), teamID(pc->teamID), curCrd(pc->curCrd), curRect(pc->curRect) {}
+};
+
 //*************************************************************************************************
 // ----- This structure wrappers all the information that is sent from
 // ----- camera-threads to the handler-thread
@@ -23,13 +37,12 @@ struct TrackInfo {
 		int ballCandID;
 		Rect rect;
 		Point coord, predCoord, GTcoord; // measured coordinate, predicted coordinate, ground truth coordinate
-		bool allowTracking;
 		bool current;
 
 		/********************************************************************************
 										Player Information
 		*********************************************************************************/
-		vector<PlayerCandidate*> pCandidates;
+		vector<PlayerInfo> players;
 
 
 		//=========================================================================================
@@ -44,7 +57,10 @@ struct TrackInfo {
 			this->GTcoord = GTcoord;
 			
 			// Player info
-			pCandidates = _pCandidates;
+			players.clear();
+			for (auto pc : _pCandidates) {
+				players.push_back(PlayerInfo(pc));
+			}
 			
 		}
 
@@ -5,12 +5,15 @@
 #include <set>
 
 #include "AppearanceAnalyzer.h"
+#include "OcclusionSolver.h"
 #include "AccuracyMetric.h"
 #include "BallCandidate.h"
 #include "PlayerCandidate.h"
 #include "TemplateGenerator.h"
 #include "TrackInfo.h"
 #include "MultiCameraTracker.h"
+#include "TaskPool.h"
+#include "StageProfiler.h"
 #include <fstream>
 
 #include "globalSettings.h"
@@ -36,16 +39,19 @@ class Tracker {
 		BallCandidate* mainCandidate;
 		vector<PlayerCandidate*> pCandidates;
 		AppearanceAnalyzer appearAnalyzer;
+		OcclusionSolver occlusionSolver;
 		bool flg;
 		Point defRad, iniRad, attachRad, searchIncRad;
 		Mat restrictedArea, trajFrame;
 		int trajLastFrame;
 		Point trajLastPoint;
-		double M1_loose_threshold, M1_find_threshold, perspectiveRatio;
+		double M1_loose_threshold, M1_find_threshold;
+		PerspectiveModel perspective;
 		TrackInfo trackInfo;
 		TRACKER_STATE trackerState;
 		vector<Point> mainCandidateTraj, givenTrajectory;
 		AccuracyMetric metric;
+		TaskPool* pool;
 
 		// Cooperative Tracking
 		vector<Rect> region;
@@ -58,7 +64,7 @@ class Tracker {
 	public:
 
 		//=========================================================================================
-		Tracker() {}
+		Tracker() : pool(NULL) {}
 
 		//=========================================================================================
 		void ball_addCandidateManually (int x, int y) 
@@ -73,7 +79,8 @@ class Tracker {
 		void initialize (int TID) {
 
 			appearAnalyzer.setBallTempls(ballTempls);
-			appearAnalyzer.generateClassifier();
+			appearAnalyzer.setTeamModel(ModelRegistry::instance().getTeamModel());
+			occlusionSolver.setTeamModel(ModelRegistry::instance().getTeamModel(), fSize.y);
 
 			curFrame = 0;
 			flg = true;
@@ -113,10 +120,25 @@ class Tracker {
 			trackerState = TRACKER_STATE::BALL_NOT_FOUND;
 		}
 
+		//=========================================================================================
+		void setFieldRegion (Mat& regionMask) {
+			// ----- no ball is searched off the pitch -----
+			restrictedArea.setTo(0.0, regionMask == 0);
+			appearAnalyzer.setRestrictedArea(restrictedArea);
+		}
+
 		//=========================================================================================
 		void setBallTempls (vector<Mat>& ballTempls) {
 			this->ballTempls = ballTempls;
 			appearAnalyzer.setBallTempls(ballTempls);
+			perspective = appearAnalyzer.getPerspective();
+		}
+
+		//=========================================================================================
+		void setBallBank (const BallTemplateBank& bank) {
+			ballTempls = bank.getImages();
+			appearAnalyzer.setBallBank(bank);
+			perspective = appearAnalyzer.getPerspective();
 		}
 
 		//=========================================================================================
@@ -126,8 +148,17 @@ class Tracker {
 		}
 
 		//=========================================================================================
-		void setPerspectiveRatio (double perspectiveRatio) {
-			this->perspectiveRatio = perspectiveRatio;
+		void setTaskPool (TaskPool* pool) {
+			// ----- ball candidates and occlusion groups are solved on the pool (sequentially if NULL) -----
+			this->pool = pool;
+			occlusionSolver.setTaskPool(pool);
+		}
+
+		//=========================================================================================
+		void setPerspective (const PerspectiveModel& perspective) {
+			// ----- the ball radiuses of the rows come from the templates the analyzer has -----
+			appearAnalyzer.setPerspective(perspective);
+			this->perspective = appearAnalyzer.getPerspective();
 		}
 
 		//=========================================================================================
@@ -152,6 +183,21 @@ class Tracker {
 			return trackInfo;
 		}
 
+		//=========================================================================================
+		AccuracyMetric getMetric () {
+			return metric;
+		}
+
+		//=========================================================================================
+		AppearanceAnalyzer& getAppearAnalyzer () {
+			return appearAnalyzer;
+		}
+
+		//=========================================================================================
+		OcclusionSolver& getOcclusionSolver () {
+			return occlusionSolver;
+		}
+
 		//=========================================================================================
 		void getTruePositivesTraj (vector<Point>& vctr) {
 			vctr = mainCandidateTraj;
@@ -324,8 +370,13 @@ class Tracker {
 		void processFrame(Mat& frame, vector<Point>& ball_cand, vector<Rect>& player_cand, vector<ProjCandidate*> Ball, int TID, int processedFrames, ofstream& file, Mat mask) {
 
 			this->Ball = Ball;
+			StageTimer playersTimer(TID, STAGE_TRACK_PLAYERS);
 			trackPlayers(player_cand, frame, TID, mask);
+			playersTimer.stop();
+
+			StageTimer ballTimer(TID, STAGE_TRACK_BALL);
 			trackBall(frame, ball_cand, Ball, TID, processedFrames);
+			ballTimer.stop();
 			drawTrajectory(frame, 2);
 			updateMetric(file, processedFrames);
 
@@ -397,8 +448,14 @@ class Tracker {
 						vector<double> matchProbs;
 						appearAnalyzer.getMatches(bc, 1, matchPoints, matchProbs, TID);
 
-						Point nCrd = matchPoints[0];
-						double nProb = matchProbs[0];
+						// ----- no template position fits the window: nothing found -----
+						Point nCrd = bc->curCrd;
+						double nProb = 0.0;
+						if (!matchPoints.empty())
+						{
+							nCrd = matchPoints[0];
+							nProb = matchProbs[0];
+						}
 
 						// Ball found
 						if (nProb > 0.955)
@@ -433,8 +490,14 @@ class Tracker {
 						vector<double> matchProbs;
 						appearAnalyzer.getMatches(bc, 1, matchPoints, matchProbs, TID);
 
-						Point nCrd = matchPoints[0];
-						double nProb = matchProbs[0];
+						// ----- no template position fits the window: nothing found -----
+						Point nCrd = bc->curCrd;
+						double nProb = 0.0;
+						if (!matchPoints.empty())
+						{
+							nCrd = matchPoints[0];
+							nProb = matchProbs[0];
+						}
 
 						// Ball found
 						if (nProb > M1_find_threshold)
@@ -490,8 +553,14 @@ class Tracker {
 						vector<double> matchProbs;
 						appearAnalyzer.getMatches(bc, 1, matchPoints, matchProbs, TID);
 
-						Point nCrd = matchPoints[0];
-						double nProb = matchProbs[0];
+						// ----- no template position fits the window: nothing found -----
+						Point nCrd = bc->curCrd;
+						double nProb = 0.0;
+						if (!matchPoints.empty())
+						{
+							nCrd = matchPoints[0];
+							nProb = matchProbs[0];
+						}
 
 						// Ball found
 						if (nProb > M1_loose_threshold)
@@ -541,8 +610,14 @@ class Tracker {
 				vector<double> matchProbs;
 				appearAnalyzer.getMatches(bc, 1, matchPoints, matchProbs, TID);
 
-				Point nCrd = matchPoints[0];
-				double nProb = matchProbs[0];
+				// ----- no template position fits the window: nothing found -----
+				Point nCrd = bc->curCrd;
+				double nProb = 0.0;
+				if (!matchPoints.empty())
+				{
+					nCrd = matchPoints[0];
+					nProb = matchProbs[0];
+				}
 
 				// Ball found
 				if (nProb > M1_find_threshold)
@@ -666,10 +741,7 @@ class Tracker {
 						ball_addMoreCandidates(newCandidates, frame, 2, TID);
 					}
 					
-					for (auto bc : bCandidates) 
-					{
-						ball_updateBallCandidate(bc, frame, TID);
-					}
+					ball_updateBallCandidates(frame, TID);
 										
 					ball_removeLostCandidates();
 					ball_removeStuckedCandidates(0.4);
@@ -692,10 +764,7 @@ class Tracker {
 						return;
 					}
 
-					for (auto bc : bCandidates) 
-					{
-						ball_updateBallCandidate(bc, frame, TID);
-					}
+					ball_updateBallCandidates(frame, TID);
 
 					ball_removeLostCandidates();
 					ball_removeStuckedCandidates(0.4);
@@ -757,11 +826,7 @@ class Tracker {
 
 		//=========================================================================================
 		inline Point perspectiveRad (Point curRad, Point crd) {
-
-			double d = double(crd.y) / fSize.y;
-			double scale = perspectiveRatio + (1 - perspectiveRatio) * d;
-			return Point(int(scale * curRad.x), int(scale * curRad.y));
-
+			return perspective.scaleRad(curRad, crd.y);
 		}
 
 		//=========================================================================================
@@ -809,12 +874,15 @@ class Tracker {
 					/**********************************************************
 					No nearest player - Continue. Correlate and search for best match
 					***********************************************************/
+					#ifdef KF_WINDOWS
+						ball_fitPredictedWindow(bc);
+					#endif
 					
 					vector<Point> matchPoints;
 					vector<double> matchProbs;
 					appearAnalyzer.getMatches(bc, 1, matchPoints, matchProbs, TID);
 
-					// matchPoints is never empty
+					// ----- no template position fits the window -----
 					if (matchPoints.empty()) 
 					{
 						bc->switchState(curFrame, BALL_STATE::GOT_LOST);
@@ -864,8 +932,14 @@ class Tracker {
 					***********************************************************/
 					appearAnalyzer.getMatches(bc, 1, matchPoints, matchProbs, TID);
 					
-					Point nCrd   = matchPoints[0];
-					double nProb = matchProbs[0];
+					// ----- no template position fits the window: nothing found -----
+					Point nCrd   = bc->curCrd;
+					double nProb = 0.0;
+					if (!matchPoints.empty())
+					{
+						nCrd = matchPoints[0];
+						nProb = matchProbs[0];
+					}
 
 					// Match found
 					if (nProb > M1_find_threshold) 
@@ -952,7 +1026,9 @@ class Tracker {
 							vector<double> matchProbs;
 
 							// Correlate.. Task -> include distance constraint ( Use filter )
-							appearAnalyzer.getMatches(bc, 2, matchPoints, matchProbs, TID);
+							// ----- distinct peaks only: the ones closer than a ball diameter are the same ball -----
+							int nmsRadius = 2 * int(perspective.getBallRadius(bc->curCrd.y) + 0.5f);
+							appearAnalyzer.getMatches(bc, ATTACHED_BALL_PEAKS, matchPoints, matchProbs, TID, nmsRadius);
 
 							vector<Point>  nCrds = matchPoints;
 							vector<double> nProbs = matchProbs;
@@ -994,6 +1070,13 @@ class Tracker {
 								}
 							}
 
+							// ----- no template position fits the window -----
+							if (nProbs.empty())
+							{
+								bc->curAppearM = 0.0;
+								break;
+							}
+
 							// Safest match not found - Designate the highest match as the ball
 							if (nProbs[0] > 0.96)
 							{
@@ -1044,6 +1127,30 @@ class Tracker {
 			bc->updateStep();
 		}
 
+		//=========================================================================================
+		void ball_fitPredictedWindow (BallCandidate* bc) {
+			// ---------- window around the position the Kalman filter expects, as large as its uncertainty
+			// ---------- (KF_WINDOW_SIGMAS) plus the ball, never larger than the default window ----------
+			Matx22f uncertainty;
+			Point2f pred = bc->KF.peek(uncertainty);
+			bc->predCrd = Point(cvRound(pred.x), cvRound(pred.y));
+
+			int ballRad = int(ceil(perspective.getBallRadius(bc->predCrd.y))) + 1;
+			Point maxRad = perspectiveRad(defRad, bc->predCrd);
+			Point rad(ballRad + int(ceil(KF_WINDOW_SIGMAS * sqrt(std::max(uncertainty(0, 0), 0.0f)))),
+					  ballRad + int(ceil(KF_WINDOW_SIGMAS * sqrt(std::max(uncertainty(1, 1), 0.0f)))));
+			bc->curRad = Point(std::min(rad.x, std::max(maxRad.x, ballRad)), std::min(rad.y, std::max(maxRad.y, ballRad)));
+			bc->fitFrame(bc->predCrd);
+		}
+
+		//=========================================================================================
+		void ball_updateBallCandidates (Mat& frame, int TID) {
+			// ----- candidates only modify themselves, idle workers can pick them up -----
+			parallelFor(pool, int(bCandidates.size()), [&](int i) {
+				ball_updateBallCandidate(bCandidates[i], frame, TID);
+			});
+		}
+
 		//=========================================================================================
 		void ball_updateCandGroups () {
 			bCandidatesGroups.clear();
@@ -1148,6 +1255,7 @@ class Tracker {
 			static int count = 0;
 
 			appearAnalyzer.setFrame(frame);
+			appearAnalyzer.setPlayerMask(mask);
 
 			// calculate coords for all new candidates
 			vector<Point> newCandCoords;
@@ -1186,8 +1294,12 @@ class Tracker {
 
 					// Set newly detected rectangle as curRect
 					Rect nRect = newCandidates[minIdx];
-					int pCandidate_teamID = appearAnalyzer.getTeamID(newCandidates[minIdx]);
-					p->teamID = pCandidate_teamID;
+					// ----- the team is kept, it is checked again from time to time or when it was unsure -----
+					if (curFrame - p->teamCheckTime >= TEAM_RECHECK_FRAMES || p->teamConfidence < TEAM_MIN_CONFIDENCE)
+					{
+						p->teamID = appearAnalyzer.getTeamID(nRect, p->teamConfidence);
+						p->teamCheckTime = curFrame;
+					}
 					p->setRect(nRect);
 
 					p->Occlusion = true;
@@ -1224,48 +1336,19 @@ class Tracker {
 				if (usedCandidates[i] == 0)
 				{
 					// Get team
-					int pCandidate_teamID = appearAnalyzer.getTeamID(newCandidates[i]);
+					double teamConfidence;
+					int pCandidate_teamID = appearAnalyzer.getTeamID(newCandidates[i], teamConfidence);
 
 					// Construct player obj
-					pCandidates.push_back(new PlayerCandidate(curFrame, newCandCoords[i], newCandidates[i], appearAnalyzer.getTeamID(newCandidates[i]), true));
+					pCandidates.push_back(new PlayerCandidate(curFrame, newCandCoords[i], newCandidates[i], pCandidate_teamID, true));
+					pCandidates.back()->teamConfidence = teamConfidence;
 				}
 			}
 			
 			// ----- Identify players under occlusion
-			/*for (int i = 0; i < pCandidates.size(); i++)
-			{
-				auto cand1 = pCandidates[i];
-
-				vector<PlayerCandidate*> playersOccluded;
-				vector<Rect> playersRect; 		
-				vector<int> usedID;
-
-				playersOccluded.push_back(cand1);
-				playersRect.push_back(cand1->curRect);
-				usedID.push_back(i);
-
-				// Loop through other players
-				for (int j = 0; j < pCandidates.size(); j++)
-				{
-					// Same player or not enough data to process
-					if (i == j || pCandidates[j]->prevRects.size() < 2) continue;
-
-					auto cand2 = pCandidates[j];
-					Point cand2Crd = Point(cand2->curCrd.x, cand2->curCrd.y - cand2->curRect.height / 2);
-
-					// Center of other player is inside of current player and their areas differ significantly
-					if (cand1->curRect.contains(cand2Crd) && cand1->curRect.area() > 1.7 * cand2->curRect.area())
-					{
-						playersOccluded.push_back(pCandidates[j]);
-						playersRect.push_back(pCandidates[j]->curRect);
-						usedID.push_back(j);
-					}
-				}
-
-				// Solve for Occlusion
-				if (playersOccluded.size() > 1)
-					appearAnalyzer.segmentPlayer(playersOccluded, mergeBoundingBoxes(playersRect), frame, TID, mask);
-			}*/
+			#ifdef OCCLUSION_SOLVER
+			occlusionSolver.solve(pCandidates, frame, mask);
+			#endif
 
 			// ----- update info for all players -----
 			for (auto p : pCandidates) 
@@ -1481,11 +1564,12 @@ class Tracker {
 				}
 			}
 
-			appearAnalyzer.setFrame(frame);
+			// ----- the frame is set by trackBall: the new windows share the correlation of the tracked ones -----
 
 			// Calculate score for tCandidates
-			for (auto possCand : tCandidates)
+			parallelFor(pool, int(tCandidates.size()), [&](int i)
 			{
+				BallCandidate* possCand = tCandidates[i];
 				vector<Point> points;
 				vector<double> probs;
 
@@ -1511,7 +1595,7 @@ class Tracker {
 
 				possCand->curAppearM = nProb;
 				possCand->updateStep();
-			}
+			});
 
 			// From tCandidates, pick the good ones ( can be > 1 ) to be stored into ballCandidates or bc
 			sort(tCandidates.begin(), tCandidates.end(), BallCandidate::compareLastAppearM);
@@ -76,7 +76,8 @@ class TrajectoryAnalyzer {
 		}
 
 		//=========================================================================================
-		static void readFullTrajectory (vector<vector<Point>>& trajectory, double scale, int startFrame, int endFrame) {
+		static void readFullTrajectory (vector<vector<Point>>& trajectory, double scale, int startFrame, int endFrame,
+										string folder = "ground_truth_ordered\\", bool issiaShift = true) {
 			
 			trajectory.clear();
 
@@ -85,7 +86,8 @@ class TrajectoryAnalyzer {
 				vector<pair<int, Point>> xmlTraj, processedTraj;
 
 				// Stores ball position in xmlTraj
-				int res = xmlParser::parseBallPositions("ground_truth_ordered\\ground_truth_" + to_string(idx) + ".xgtf", xmlTraj);
+				// ----- ball positions of the cameras 2, 4 and 6 are mirrored -----
+				int res = xmlParser::parseBallPositions(folder + "ground_truth_" + to_string(idx) + ".xgtf", xmlTraj, idx % 2 == 0);
 
 				if (res)
 				{
@@ -114,9 +116,10 @@ class TrajectoryAnalyzer {
 					case (6) : { shift = -5; break; } // -4
 				}
 
-				TrajectoryAnalyzer::shiftTrajectory(xmlTraj, shift);
+				// ----- only the ISSIA ground truth is ahead of its videos -----
+				if (issiaShift) TrajectoryAnalyzer::shiftTrajectory(xmlTraj, shift);
 
-				int length = endFrame - startFrame + 1;
+				int length = std::max(endFrame - startFrame + 1, 0);
 				vector<Point> traj (length, outTrajPoint);
 				
 				// Error here
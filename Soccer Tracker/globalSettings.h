@@ -3,6 +3,7 @@
 #include <tchar.h>
 #include <string>
 #include <ctime>
+#include <atomic>
 
 namespace st {
 
@@ -14,11 +15,14 @@ namespace st {
 cv::Point fSize, mSize;
 cv::Point BALL_DRAW_RAD;
 const cv::Point outTrajPoint(-1,-1);
-int ID_counter, ID_shift, ID_groups_cnt;
+std::atomic<int> ID_counter; // candidates are created by several threads at once
+thread_local int ID_shift;   // index of the camera whose candidates the thread creates
+int ID_groups_cnt;
 int CAMERAS_CNT;
 double scaleLoad = 0.5;
 const int gui_camPreviewH = 1080, gui_camPreviewW = 1920;
 const int gui_modelH = 652, gui_modelW = 948;
+const double MODEL_METERS_PER_PX_X = 0.05464, MODEL_METERS_PER_PX_Y = 0.06291; // field model: 105 x 68 m over 1920 x 1080 pixels
 
 #define WRITE_VIDEO // save video to disk
 //#define DISPLAY_GROUND_TRUTH // display ground truth
@@ -27,9 +31,29 @@ const int gui_modelH = 652, gui_modelW = 948;
 #define PLAYERS_KF // apply Kalman Filtering for players
 #define WINDOW_PERSPECTIVE // take distance to the camera into the considiration
 #define THREE_DIMENSIONAL_ANALYSIS
+#define PROFILE_STAGES // collect latency histograms of all pipeline stages
+#define FIELD_REGION // segment only the part of the frames where the pitch is (from the homographies)
+#define FUSED_GREEN_SEGMENTATION // segment on the green chromaticity only, the mask is the same as with all 3 channels
+#define SHARED_CORRELATION // ball templates are matched once per frame over the union of the candidate windows
+#define PYRAMID_SEARCH // large ball windows are searched at half resolution first, the best peaks are refined
+#define KF_WINDOWS // windows of tracked balls follow the Kalman prediction and grow with its uncertainty
+//#define COMPACT_TEAM_FEATURE // teams are told apart by a 32-bin colour signature instead of the classifier (off until its agreement with it is measured on the dataset)
+#define OCCLUSION_SOLVER // players merged into one blob are separated by their team templates on every frame
+#define SMALL_TEMPLATE_KERNEL // ball templates are matched by the AVX2 small-template kernel instead of the DFT of the bank
 
 const int OUT_FRAME_RATE = 25; // frame rate for writing video
 const int SLOW_MOTION_REPEAT_TIME = 20; // slows down the tracking
+const int ATTACHED_BALL_PEAKS = 4; // distinct correlation peaks searched around a player holding the ball
+const int PYRAMID_MIN_AREA = 12000; // ball windows with more template positions are searched coarse-to-fine
+const int PYRAMID_PEAKS = 3; // coarse peaks refined for every requested peak
+const double KF_WINDOW_SIGMAS = 3.0; // half-size of a tracking window in standard deviations of the prediction
+const int TEAM_RECHECK_FRAMES = 25; // a tracked player's team is kept and classified again after this many frames
+const double TEAM_MIN_CONFIDENCE = 0.2; // ... or on every frame while the margin to the second team is below this
+const int TEAM_CALIBRATION_SAMPLES = 100; // crops of every team the compact prototypes are averaged from
+const double TEAM_SAMPLE_MARGIN = 0.1; // ... labelled by the classifier with at least this margin to the second team
+const int TEAM_AGREEMENT_CHECKS = 500; // compact labels compared with the classifier after the calibration
+const double OCCLUSION_BUDGET_MS = 3.0; // no occlusion group is started later than this after the first one
+const int OCCLUSION_MAX_GROUP = 4; // players separated in one blob at most
 
 //*************************************************************************************************
 enum BALL_STATE {
@@ -45,6 +69,30 @@ enum BALL_STATE {
 	BALL_STATES_COUNT
 };
 
+//*************************************************************************************************
+enum PROFILE_STAGE {
+	// ----- camera stages -----
+	STAGE_DECODE,			// decoder-thread: reading a frame from the video
+	STAGE_RESIZE_FLIP,		// decoder-thread: resizing and flipping it
+	STAGE_DECODE_WAIT,		// camera waiting for a decoded frame
+	STAGE_NORMALIZE,
+	STAGE_SMOOTH,
+	STAGE_HIST_METHOD,
+	STAGE_CONTOURS,
+	STAGE_TRACK_PLAYERS,
+	STAGE_TRACK_BALL,
+	STAGE_DRAW,
+	STAGE_BARRIER_WAIT,		// result of the camera waiting for the slowest camera
+	// ----- fusion stages -----
+	STAGE_UPDATE_TRACK_DATA,
+	STAGE_IDENTIFY_TP,
+	STAGE_COMPUTE_3D,
+	STAGE_CAMERA_HANDOFF,
+	STAGE_FINALIZE,
+
+	PROFILE_STAGES_COUNT
+};
+
 //*************************************************************************************************
 enum TRACKER_STATE {
 	BALL_NOT_FOUND,
@@ -52,6 +100,13 @@ enum TRACKER_STATE {
 	TRUE_POSITIVE_FOUND
 };
 
+//*************************************************************************************************
+enum MATCH_BACKEND {
+	MATCH_OPENCV,			// matchTemplate
+	MATCH_TEMPLATE_BANK,	// precomputed spectra of the ball template bank (CorrelationCache tiles only)
+	MATCH_SMALL_KERNEL		// SmallTemplateMatcher (templates up to 24 x 24, AVX2)
+};
+
 //=================================================================================================
 inline std::string getTimeString () {
 	auto t = time(0);
@@ -12,9 +12,16 @@
 #include "ContourAnalyzer.h"
 #include "Tracker.h"
 #include "MultiCameraTracker.h"
+#include "FrameScheduler.h"
+#include "CameraPipeline.h"
+#include "TaskPool.h"
+#include "RunOptions.h"
+#include "StageProfiler.h"
+#include "ModelRegistry.h"
+#include "SyntheticScene.h"
 #include "globalSettings.h"
 
-#include "omp.h"
+#include <chrono>
 
 using namespace cv;
 using namespace std;
@@ -23,7 +30,7 @@ using namespace st;
 //*************************************************************************************************
 // ----- This is a main source file it handles the whole process of tracking:
 // ----- opens video, reads all configuration and calibration data, starts tracking,
-// ----- manipulate threads, handles keyboard and mouse control, etc.
+// ----- schedules the work of all cameras on the task pool, handles keyboard and mouse control, etc.
 //*************************************************************************************************
 
 
@@ -41,7 +48,6 @@ void _onMouse(int event, int x, int y, int flags, void* param) {
 
 	if (event == CV_EVENT_LBUTTONUP) 
 	{
-		#pragma omp flush(pauseFlag, TID_mouseUpdate)
 		if ((pauseFlag == 2) && (TID_mouseUpdate == -1)) 
 		{
 			Point clickP = Point(x, y);
@@ -51,11 +57,8 @@ void _onMouse(int event, int x, int y, int flags, void* param) {
 				if (r.contains(clickP)) 
 				{
 					clickP -= Point(r.x, r.y);
-					#pragma omp critical(x_)
 					x_ = int(1.0 / (scalePreview / scaleLoad) * clickP.x);
-					#pragma omp critical(y_)
 					y_ = int(1.0 / (scalePreview / scaleLoad) * clickP.y);
-					#pragma omp critical(TID_mouseUpdate)
 					TID_mouseUpdate = int(i);
 					break;
 				}
@@ -65,32 +68,24 @@ void _onMouse(int event, int x, int y, int flags, void* param) {
 
 	else if (event == CV_EVENT_RBUTTONDOWN)	{
 		// ---------- PAUSE mode ----------
-		#pragma omp critical(pauseFlag)
+		if (pauseFlag != 2) 
 		{
-			if (pauseFlag != 2) 
-			{
-				printf("PAUSE\n"); fflush(stdout);
-				pauseFlag = 2;
-			}
-			else if (pauseFlag == 2) 
-			{
-				printf("CONTINUE\n"); fflush(stdout);
-				pauseFlag = 0;
-			}
+			printf("PAUSE\n"); fflush(stdout);
+			pauseFlag = 2;
+		}
+		else if (pauseFlag == 2) 
+		{
+			printf("CONTINUE\n"); fflush(stdout);
+			pauseFlag = 0;
 		}
 	}
 }
 
 
 //=================================================================================================
-int main() {
+int main(int argc, char** argv) {
 	
-	vector<vector<Point>> givenTrajectories;
-	#ifdef NOT_FROM_THE_BEGINING
-	TrajectoryAnalyzer::readFullTrajectory(givenTrajectories, 0.5, START_FRAME, 2997);
-	#else
-	TrajectoryAnalyzer::readFullTrajectory(givenTrajectories, 0.5, 0, 2997);
-	#endif
+	RunOptions options = RunOptions::parse(argc, argv);
 
 	ofstream outFile[6];
 	stringstream sstm;
@@ -109,6 +104,9 @@ int main() {
 	_sstm << "TriangulationError" << ".txt";
 	t_Error.open(_sstm.str());
 
+	ofstream waitLog;
+	waitLog.open("FrameWaits.txt");
+
 	// Save Ground Truth to file
 	//ofstream outFile[6];
 	//static stringstream sstm;
@@ -173,354 +171,393 @@ int main() {
 	scalePreview = 1.0 / 3; // preview size will be 640 x 360
 
 	// Camera Coordinates are not at the extreme corners. Origin is at top left
-	camHandler.addCamera(1, Point(1280, 540), scalePreview, Point3d(87.56, 67.928 + 34.52, 60.69));	// Original: 0, 540		
-	camHandler.addCamera(2, Point(1280, 180), scalePreview, Point3d(87.69, 67.928 - 103.14, 60.62));		// Original: 640, 540
+	struct CameraSetup { int idx; Point previewPos; Point3d coords; };
+	CameraSetup cameraSetups[] = {
+		{ 1, Point(1280, 540), Point3d(87.56, 67.928 + 34.52, 60.69) },		// Original: 0, 540
+		{ 2, Point(1280, 180), Point3d(87.69, 67.928 - 103.14, 60.62) },	// Original: 640, 540
+
+		{ 3, Point(640, 540), Point3d(53.15, 67.928 + 34.13, 56.51) },		// Original: 1280, 540
+		{ 4, Point(640, 180), Point3d(52.37, 67.928 - 101.78, 57.93) },		// Original: 0, 180
+
+		{ 5, Point(0, 540), Point3d(27.84, 67.928 + 33.97, 59.50) },		// Original: 640, 180
+		{ 6, Point(0, 180), Point3d(27.84, 67.928 - 102.09, 58.83) }		// Original: 1280, 180
+	};
+	int camerasCnt = (options.camerasCnt > 0) ? std::min(options.camerasCnt, 6) : 6;
+
+	// ---------- synthetic match: videos and ground truth are rendered before the cameras open them ----------
+	string groundTruthFolder = "ground_truth_ordered\\";
+	int groundTruthEnd = 2997;
+	Mat syntheticModel;
+	if (options.synthetic) 
+	{
+		string syntheticFolder = "synthetic\\";
+		createFolder(syntheticFolder);
 
-	camHandler.addCamera(3, Point(640, 540), scalePreview, Point3d(53.15, 67.928 + 34.13, 56.51));	// Original: 1280, 540
-	camHandler.addCamera(4, Point(640, 180), scalePreview, Point3d(52.37, 67.928 - 101.78, 57.93));		// Original: 0, 180		
+		SyntheticScene scene(configurator, Size(options.syntheticWidth, options.syntheticHeight), options.syntheticPlayers, options.syntheticSeed);
+		for (int i = 0; i < camerasCnt; i++) scene.addCamera(cameraSetups[i].idx, cameraSetups[i].coords);
+		scene.render(syntheticFolder, options.syntheticLength, OUT_FRAME_RATE);
 
-	camHandler.addCamera(5, Point(0, 540), scalePreview, Point3d(27.84, 67.928 + 33.97, 59.50));		// Original: 640, 180
-	camHandler.addCamera(6, Point(0, 180), scalePreview, Point3d(27.84, 67.928 - 102.09, 58.83));			// Original: 1280, 180
+		syntheticModel = scene.getFieldModel();
+		camHandler.setVideoFolder(syntheticFolder);
+		groundTruthFolder = syntheticFolder;
+		groundTruthEnd = options.syntheticLength - 1;
+	}
+
+	for (int i = 0; i < camerasCnt; i++) 
+	{
+		camHandler.addCamera(cameraSetups[i].idx, cameraSetups[i].previewPos, scalePreview, cameraSetups[i].coords);
+	}
 
 	camHandler.updateFSize();
+
+	// ----- the dataset ground truth starts at START_FRAME, a synthetic match is tracked from its first frame -----
+	#ifdef NOT_FROM_THE_BEGINING
+	int startFrame = options.synthetic ? 0 : START_FRAME;
+	#else
+	int startFrame = 0;
+	#endif
+
+	vector<vector<Point>> givenTrajectories;
+	TrajectoryAnalyzer::readFullTrajectory(givenTrajectories, 0.5, startFrame, groundTruthEnd, groundTruthFolder, !options.synthetic);
+
 	vector<Camera*> allCameras = camHandler.getCameras();
 
+	// ----- number of decoded frames kept ready ahead of every camera thread -----
+	int prefetchDepth = std::max(configurator->readObject<int>("prefetchDepth"), 1);
+	// ----- how many frames camera threads may run ahead of the fusion (0 = lockstep) -----
+	int fusionStaleness = configurator->readObject<int>("fusionStaleness");
+	// ----- when the mask of the pitch colours is rebuilt and when the background is dropped -----
+	double histDriftDistance = configurator->readObject<double>("histDriftDistance");
+	double sceneCutDistance = configurator->readObject<double>("sceneCutDistance");
+	// ----- the background model of every camera survives restarts -----
+	int backgroundSaveInterval = configurator->readObject<int>("backgroundSaveInterval");
+	#ifdef FIELD_REGION
+	double fieldMargin = configurator->readObject<double>("fieldMargin");
+	double fieldHeadroom = configurator->readObject<double>("fieldHeadroom");
+	#endif
+
 	#ifdef WRITE_VIDEO
 	// ---------- create output videos ----------
+	// ----- nothing is drawn in headless mode, so there is nothing to write -----
 	int vidOutExt = CV_FOURCC('M', 'J', 'P', 'G'); //videoReader->getCodecExt();	// another way: vidOutExt = CV_FOURCC('M','J','P','G');
-	for (auto camera : allCameras) {
-		videoWriter.addVideo(to_string(camera->idx) + "_.avi", fSize, OUT_FRAME_RATE, vidOutExt, camera->idx);
+	if (!options.headless) 
+	{
+		for (auto camera : allCameras) {
+			videoWriter.addVideo(to_string(camera->idx) + "_.avi", fSize, OUT_FRAME_RATE, vidOutExt, camera->idx);
+		}
+		videoWriter.addVideo("all_.avi", Size(gui_camPreviewW, gui_camPreviewH), OUT_FRAME_RATE, vidOutExt, -1);
+		videoWriter.addVideo("model_.avi", Size(gui_modelW, gui_modelH), OUT_FRAME_RATE, vidOutExt, -2);
 	}
-	videoWriter.addVideo("all_.avi", Size(gui_camPreviewW, gui_camPreviewH), OUT_FRAME_RATE, vidOutExt, -1);
-	videoWriter.addVideo("model_.avi", Size(gui_modelW, gui_modelH), OUT_FRAME_RATE, vidOutExt, -2);
 	#endif
 
+	// ----- frame rate of the source videos, used to compare the throughput with real time -----
+	double sourceFps = allCameras[0]->capture.get(CV_CAP_PROP_FPS);
+	if (sourceFps <= 0) sourceFps = OUT_FRAME_RATE;
+
 	// ---------- prepare for multithreading ----------
-	omp_set_num_threads(CAMERAS_CNT + 1);
-	int processedFrames_s = 0, camerasReady = 0;
-	TrackInfo* trackInfo = new TrackInfo[CAMERAS_CNT];
+	int processedFrames_s = 0;
+	FrameScheduler scheduler(CAMERAS_CNT, fusionStaleness);
+	int staleness = scheduler.getStaleness();
+	if (fusionStaleness > staleness) printf("fusionStaleness %d is clamped to %d\n", fusionStaleness, staleness);
+	// ----- TrackInfo of the frames that are not fused yet, fused ball state of the last frames -----
+	vector<vector<TrackInfo>> trackInfo(scheduler.getTrackSlotsCnt(), vector<TrackInfo>(CAMERAS_CNT));
+	vector<vector<ProjCandidate>> fusedBall(scheduler.getFusedSlotsCnt());
+	// ----- cameras render the next frame while the current one is shown -----
+	Mat cameraViews[2] = { cameraView, cameraView.clone() };
 	bool showTraj = false, slowMotion = false;
 
 	ID_counter = 0;
 	ID_groups_cnt = 10;
 
-	//*********************************************************************************************
-	//******************************** parallel threads *******************************************
-	//*********************************************************************************************
-	#pragma omp parallel shared(trackInfo, processedFrames_s, x_, y_, camerasReady, pauseFlag, cameraView, showTraj, slowMotion)
-	{
-		int TID = omp_get_thread_num();
-		int debugger = 0;
-		
-		Ptr<BackgroundSubtractorMOG2> MOG2;
-		MOG2 = createBackgroundSubtractorMOG2();
-		MOG2->setShadowValue(0);
-
-		#pragma omp critical
-		trackInfo[TID].allowTracking = true;
-		ID_shift = TID;
-
-		if (TID < CAMERAS_CNT) 
-		{
-			//_____________________________________________________________________________________
-			//********************************************* camera thread *************************
-			//*************************************************************************************
-			int processedFrames = 0;
-			// ----- do some initialization for every camera -----
-			Camera* camera = allCameras[TID];
-			VideoCapture camCapture = camera->capture;
-			Rect camViewRect = camera->viewRect;
-			bool horFlip = camera->viewHFlip;
-			#ifdef WRITE_VIDEO
-			cv::VideoWriter vidWriter = videoWriter.getVideoWriter(camera->idx);
-			#endif
-			Mat frame;
-			BackGroundRemover remover(500, 256, 5, false);
-			ContourAnalyzer cAnalyzer;
-			
-			Tracker tracker;
-			tracker.initialize(TID);
-			tracker.setBallTempls(camera->ballTemplates);
-			tracker.setPerspectiveRatio(camera->perspectiveRatio);
-			tracker.setGivenTrajectory(givenTrajectories[TID]);
-			//=====================================================
-
-			while (true) {
-				
-				// ========== check value of pauseFlag ==========
-				#pragma omp flush (pauseFlag)
-				if (pauseFlag == 2) 
-				{
-					// ----- switch to PAUSE mode -----
-					waitKey(10);
-					#pragma omp flush(TID_mouseUpdate, x_, y_)
-					if (TID_mouseUpdate == TID) 
-					{
-						tracker.ball_addCandidateManually(x_, y_);
-						#pragma omp critical
-						TID_mouseUpdate = -1;
-					}
-
-					else 
-					{
-						continue;
-					}
-				}
-				else if (pauseFlag == 1) 
-				{
-					// ----- STOP all threads -----
-					#pragma omp critical
-					processedFrames_s = processedFrames;
-					vector<pair<int, Point>> traj;
-					printf("thread %d processed %d frames\n", TID, processedFrames); fflush(stdout);
-					break;
-				}
-
-				// ========== retrieve new frame ==========
-				
-				if (!camCapture.read(frame)) 
-				{
-					#pragma omp critical
-					pauseFlag = 1;
-					continue;
-				};
-				
-				#ifdef NOT_FROM_THE_BEGINING
-				if (processedFrames < START_FRAME) 
-				{
-					processedFrames++;
-					continue;
-				}
-				#endif
-
-				// ========== preprocess frame ==========
-				resize(frame, frame, Size(960,540), 0, 0, INTER_AREA);
-
-				if (horFlip) { flip(frame, frame, 1); } // !!!!! some source videos might be flipped !!!!!
-
-				Mat mask;
-				mask = remover.processFrame(frame, TID);
-
-				/*if (TID == 3)
-				{
-					char filename[40];
-					sprintf(filename, "result.png");
-					imwrite(filename, mask);
-					waitKey(0);
-				}*/
-
-				/*MOG2->apply(frame, mask);
+	// ----- the pool is sized to the hardware, not to the number of cameras -----
+	TaskPool pool(configurator->readObject<int>("workerThreads"));
+	printf("%d worker threads\n", pool.getThreadsCnt()); fflush(stdout);
 
-				erode(mask, mask, getStructuringElement(MORPH_RECT, Size(3, 3)));
-				dilate(mask, mask, getStructuringElement(MORPH_RECT, Size(3, 3)));*/
-				
-				Mat playerMask = mask.clone();
+	// ----- classifier and player templates are read once, on the pool, and shared by all cameras -----
+	ModelRegistry::instance().load(&pool);
 
-				vector<Rect> players_cand;
-				vector<Point> ball_cand;
+	vector<CameraPipeline*> pipelines;
+	for (int TID = 0; TID < CAMERAS_CNT; TID++) 
+	{
+		// ----- frames before startFrame are skipped by the decoder -----
+		CameraPipeline* pipeline = new CameraPipeline(TID, allCameras[TID], prefetchDepth, startFrame, givenTrajectories[TID], outFile[TID], &pool);
+		pipeline->setDriftThresholds(histDriftDistance, sceneCutDistance);
+		#ifdef FIELD_REGION
+		double coverage = pipeline->setFieldRegion(fieldMargin, fieldHeadroom);
+		if (coverage > 0)	printf("camera %d: field region covers %.0f %% of the frame\n", TID, 100 * coverage);
+		else				printf("camera %d: the pitch is not in the view, the whole frame is segmented\n", TID);
+		#endif
+		if (backgroundSaveInterval > 0) 
+		{
+			// ----- a rendered video of the same name is a different one for another scene -----
+			string modelFile = "backgroundModel" + to_string(allCameras[TID]->idx) + ".yml";
+			string source = allCameras[TID]->videoName;
+			if (options.synthetic) 
+			{
+				source += " | synthetic " + to_string(options.syntheticWidth) + "x" + to_string(options.syntheticHeight) + " players " + to_string(options.syntheticPlayers)
+					+ " seed " + to_string(options.syntheticSeed) + " length " + to_string(options.syntheticLength);
+			}
+			if (pipeline->setModelFile(modelFile, source, backgroundSaveInterval)) 
+			{
+				printf("camera %d: background model loaded from %s\n", TID, modelFile.c_str());
+			}
+		}
+		#ifdef WRITE_VIDEO
+		if (!options.headless) pipeline->setVideoWriter(videoWriter.getVideoWriter(allCameras[TID]->idx));
+		#endif
+		pipelines.push_back(pipeline);
+	}
 
-				cAnalyzer.process(mask, players_cand, ball_cand);
-				// ========== wait for permission to start tracking ==========
-				bool _flg = true;
+	//=============================================================================================
+	auto trackCamera = [&](int TID, Mat& view) {
+		// ----- fused ball state of frame t-1-staleness (nothing before the first fusion) -----
+		CameraPipeline* pipeline = pipelines[TID];
+		int t = pipeline->getTrackedFrames();
 
-				while (_flg) 
-				{
-					// !!!!! #omp: do not use flush with pointers! use critical section instead !!!!!
-					#pragma omp critical
-					if (trackInfo[TID].allowTracking || (pauseFlag == 1)) _flg = false;
-				}
+		vector<ProjCandidate*> truePositives;
+		int fusedIdx = t - 1 - staleness;
+		if (fusedIdx >= 0) 
+		{
+			for (auto& pc : fusedBall[fusedIdx % scheduler.getFusedSlotsCnt()]) truePositives.push_back(&pc);
+		}
 
-				#pragma omp critical(trackInfo)
+		/********************************************************************************
+									First Stage of Analysis
+		*********************************************************************************/
+		pipeline->track(truePositives, trackInfo[t % scheduler.getTrackSlotsCnt()][TID]);
+		if (!options.headless) pipeline->render(showTraj, view);
+		scheduler.cameraDone(TID);
+	};
+
+	//=============================================================================================
+	auto allCamerasHaveFrame = [&]() {
+		for (auto pipeline : pipelines) if (!pipeline->hasFrame()) return false;
+		return true;
+	};
+
+	#ifdef THREE_DIMENSIONAL_ANALYSIS
+	mcTracker = MultiCameraTracker();
+	Mat model = options.synthetic ? syntheticModel : imread(configurator->readObject<string>("fieldModel"));
+
+	mcTracker.setFieldModel(model);
+	mcTracker.setCameras(allCameras);
+	#endif
 
-				/********************************************************************************
-											First Stage of Analysis
-				*********************************************************************************/
-				
-				tracker.setTrackInfo(trackInfo[TID]);
-				tracker.processFrame(frame, ball_cand, players_cand, mcTracker.getTruePositives(), TID, processedFrames, outFile[TID], playerMask);
-				trackInfo[TID] = tracker.getTrackInfo();
+	#ifdef WRITE_VIDEO
+	cv::VideoWriter vidWriter_all, vidWriter_model;
+	#endif
 
-				#pragma omp critical
-				{
-					trackInfo[TID].allowTracking = false;
-					camerasReady++;
-				}
+	if (!options.headless) 
+	{
+		namedWindow("modelView", CV_WINDOW_NORMAL);
+		namedWindow("cameraView", CV_WINDOW_AUTOSIZE);
+		setMouseCallback("cameraView", _onMouse);
 
-				// ========== display results for single camera ==========
-				#pragma omp flush(showTraj)
-				if (showTraj)
-				{
-					tracker.getTrajFrame(frame);
-				}
-				else 			
-				{
-					tracker.drawTrackingMarks(frame, TID);
-				}
-				
-				#ifdef WRITE_VIDEO
-				vidWriter << frame;
-				#endif
-				
-				resize(frame, frame, Size(camViewRect.width, camViewRect.height));
+		#ifdef WRITE_VIDEO
+		vidWriter_all = videoWriter.getVideoWriter(-1);
+		vidWriter_model = videoWriter.getVideoWriter(-2);
+		#endif
+	}
 
-				frame.copyTo(cameraView(camViewRect));
+	Mat modelPreview;
+	chrono::steady_clock::time_point runStart = chrono::steady_clock::now();
 
-				if (TID == 0) 
-				{
-					cameraView(Rect(640 + 210, 0, 200, 100)) = CV_RGB(0, 0, 0);
-					putText(cameraView, to_string(processedFrames), Point(640 + 280, 50), FONT_HERSHEY_DUPLEX, 1.0, CV_RGB(255, 255, 255));
-				}
+	//*********************************************************************************************
+	//************************************ frame driver *******************************************
+	//*********************************************************************************************
+	// Camera stages run as tasks on the pool, the fusion of frame t runs on this thread meanwhile:
+	// in lockstep mode it overlaps the segmentation of frame t+1, with staleness 1 it overlaps
+	// the whole camera work (segmentation, tracking, rendering) of frame t+1.
 
+	scheduler.beginFrame();
+	{
+		TaskGroup cameras(&pool);
+		for (int TID = 0; TID < CAMERAS_CNT; TID++) 
+		{
+			cameras.run([&, TID] {
+				if (pipelines[TID]->segment() && staleness > 0) trackCamera(TID, cameraViews[0]);
+			});
+		}
+		cameras.wait();
+	}
+	if (!allCamerasHaveFrame()) pauseFlag = 1;
 
-				globalFrameCount = processedFrames;
-				processedFrames++;
+	while (true) 
+	{
+		// ---------- STOP mode ----------
+		if (pauseFlag == 1) 
+		{
+			printf("tracking stopped\n"); fflush(stdout);
+			if (!options.headless) 
+			{
+				while (true) if (waitKey(1) == 'q')	break;
+				destroyAllWindows();
 			}
+			break;
 		}
 
-		/*#ifndef THREE_DIMENSIONAL_ANALYSIS
-		else
+		// ---------- PAUSE mode: only ball candidates can be added by mouse ----------
+		if (pauseFlag == 2) 
 		{
-			namedWindow("cameraView", CV_WINDOW_AUTOSIZE);
-			imshow("cameraView", cameraView);
-
-			#pragma omp critical
-			camerasReady = 0;
-			#pragma omp critical
+			if (TID_mouseUpdate != -1) 
 			{
-				for (int i = 0; i < CAMERAS_CNT; i++)
-					trackInfo[i].allowTracking = true;
+				pipelines[TID_mouseUpdate]->addCandidateManually(x_, y_);
+				TID_mouseUpdate = -1;
 			}
 		}
-		#endif*/
-
-		#ifdef THREE_DIMENSIONAL_ANALYSIS
 		else 
 		{
-			//_____________________________________________________________________________________
-			//********************************************* handler thread ************************
-			//*************************************************************************************
+			int fusedIdx = scheduler.getFusedCount();
+			Mat& view = cameraViews[fusedIdx % 2];
 
-			// ========== do initialization ==========
-			mcTracker      = MultiCameraTracker();
-			Mat model	   = imread(configurator->readObject<string>("fieldModel"));
+			if (staleness == 0) 
+			{
+				// ----- tracking of frame t needs the fusion of frame t-1 -----
+				TaskGroup cameras(&pool);
+				for (int TID = 0; TID < CAMERAS_CNT; TID++) 
+				{
+					cameras.run([&, TID] { trackCamera(TID, view); });
+				}
+				cameras.wait();
+			}
+			scheduler.endFrame();
 
-			mcTracker.setFieldModel(model);
-			mcTracker.setCameras(allCameras);
+			// ---------- camera stages of the next frame ----------
+			scheduler.beginFrame();
+			TaskGroup cameras(&pool);
+			for (int TID = 0; TID < CAMERAS_CNT; TID++) 
+			{
+				cameras.run([&, TID] {
+					if (pipelines[TID]->segment() && staleness > 0) trackCamera(TID, cameraViews[(fusedIdx + 1) % 2]);
+				});
+			}
 
-			namedWindow("modelView", CV_WINDOW_NORMAL);
-			namedWindow("cameraView", CV_WINDOW_AUTOSIZE);
-			setMouseCallback("cameraView", _onMouse);
+			globalFrameCount = startFrame + fusedIdx;
+			scheduler.logFrame(waitLog, globalFrameCount);
 
-			#ifdef WRITE_VIDEO
-			cv::VideoWriter vidWriter_all = videoWriter.getVideoWriter(-1);
-			cv::VideoWriter vidWriter_model = videoWriter.getVideoWriter(-2);
+			/********************************************************************************
+									Second (Final) Stage of Analysis
+			*********************************************************************************/
+			#ifdef THREE_DIMENSIONAL_ANALYSIS
+			{
+				StageTimer timer(StageProfiler::FUSION, STAGE_UPDATE_TRACK_DATA);
+				mcTracker.updateTrackData(trackInfo[fusedIdx % scheduler.getTrackSlotsCnt()].data());
+			}
+			mcTracker.process(t_Error, globalFrameCount);
+			fusedBall[fusedIdx % scheduler.getFusedSlotsCnt()] = mcTracker.getTruePositivesSnapshot();
 			#endif
 
-			Mat modelPreview;
-
-			// ========== loop for all frames ==========
-			while (true) 
+			if (!options.headless) 
 			{
-				// ---------- STOP mode ----------
-				#pragma omp flush(pauseFlag)
-				if (pauseFlag == 1) 
+				#ifdef THREE_DIMENSIONAL_ANALYSIS
 				{
-					printf("handler thread stopped\n"); fflush(stdout);
-					while (true) if (waitKey(1) == 'q')	break;
-					destroyAllWindows();
-					break;
+					StageTimer timer(StageProfiler::FUSION, STAGE_FINALIZE);
+					mcTracker.finalizeResults(modelPreview, view);
 				}
+				imshow("modelView", modelPreview);
+				#endif
+				imshow("cameraView", view);
 
-				#pragma omp flush(camerasReady)
-				if (camerasReady == CAMERAS_CNT) 
-				{
-					#pragma omp critical
-
-					/********************************************************************************
-											Second (Final) Stage of Analysis
-					*********************************************************************************/
-					
-					mcTracker.updateTrackData(trackInfo);
-					mcTracker.process(t_Error, globalFrameCount);
-					mcTracker.finalizeResults(modelPreview, cameraView);
-
-					imshow("modelView", modelPreview);
-					imshow("cameraView", cameraView);
-
-					#ifdef WRITE_VIDEO
-					resize(modelPreview, modelPreview, Size(gui_modelW, gui_modelH));
-					vidWriter_model << modelPreview;
-					vidWriter_all << cameraView;
-					#endif
-
-					// ---------- cameras allowed to process next frame ----------
-					#pragma omp critical
-					camerasReady = 0;
-					#pragma omp critical
-					{
-						for (int i = 0; i < CAMERAS_CNT; i++)
-							trackInfo[i].allowTracking = true;
-					}
+				#ifdef WRITE_VIDEO
+				#ifdef THREE_DIMENSIONAL_ANALYSIS
+				resize(modelPreview, modelPreview, Size(gui_modelW, gui_modelH));
+				vidWriter_model << modelPreview;
+				#endif
+				vidWriter_all << view;
+				#endif
+			}
+
+			scheduler.frameFused();
+			cameras.wait();
+
+			// ----- the end of any video (or of the requested frames) stops the tracking -----
+			if (!allCamerasHaveFrame()) pauseFlag = 1;
+			if (options.maxFrames > 0 && scheduler.getFusedCount() >= options.maxFrames) pauseFlag = 1;
+
+			// ----- headless runs have no keyboard: the stage latencies can be printed periodically -----
+			if (options.profileInterval > 0 && scheduler.getFusedCount() % options.profileInterval == 0) StageProfiler::printReport();
+		}
+
+		if (options.headless) continue;
+
+		// ========== wait for any key to be pressed ======================================
+		for (auto i = 0; i < SLOW_MOTION_REPEAT_TIME; i++) 
+		{
+			switch (waitKey(1)) 
+			{
+				//_________________________________________________________________________
+			case 27: {	//---------------------------------------- STOP mode ----------
+				pauseFlag = 1;
+				break;
+			}
+					 //_________________________________________________________________________
+			case 't': { //--------------------------------- TRAJECTORY MODE ----------
+				showTraj = !showTraj;
+				break;
+			}
+					  //_________________________________________________________________________
+			case ' ': { //-------------------------------------- PAUSE mode ----------
+				if (pauseFlag != 2) {
+					printf("PAUSE\n"); fflush(stdout);
+					pauseFlag = 2;
 				}
-				// ========== wait for any key to be pressed ======================================
-				for (auto i = 0; i < SLOW_MOTION_REPEAT_TIME; i++) 
-				{
-					switch (waitKey(1)) 
-					{
-						//_________________________________________________________________________
-					case 27: {	//---------------------------------------- STOP mode ----------
-						#pragma omp critical
-						pauseFlag = 1;
-						break;
-					}
-							 //_________________________________________________________________________
-					case 't': { //--------------------------------- TRAJECTORY MODE ----------
-						#pragma omp critical
-						showTraj = !showTraj;
-						break;
-					}
-							  //_________________________________________________________________________
-					case ' ': { //-------------------------------------- PAUSE mode ----------
-						#pragma omp critical
-							{
-								if (pauseFlag != 2) {
-									printf("PAUSE\n"); fflush(stdout);
-									pauseFlag = 2;
-								}
-								else if (pauseFlag == 2) {
-									printf("CONTINUE\n"); fflush(stdout);
-									pauseFlag = 0;
-								}
-							}
-							break;
-					}
-							  //_________________________________________________________________________
-					case 's': { //-------------------------------- SLOW MOTION mode ----------
-						#pragma omp critical
-						slowMotion = !slowMotion;
-						break;
-					}
-					}
-
-					if (!slowMotion) {
-						break;
-					}
+				else if (pauseFlag == 2) {
+					printf("CONTINUE\n"); fflush(stdout);
+					pauseFlag = 0;
 				}
-				//=================================================================================
+				break;
+			}
+					  //_________________________________________________________________________
+			case 's': { //-------------------------------- SLOW MOTION mode ----------
+				slowMotion = !slowMotion;
+				break;
+			}
+					  //_________________________________________________________________________
+			case 'p': { //------------------------------------- STAGE LATENCY ----------
+				StageProfiler::printReport();
+				break;
+			}
 			}
 
+			if (!slowMotion) {
+				break;
+			}
 		}
-		#endif
+		//=================================================================================
+	}
+
+	double runTime = chrono::duration<double>(chrono::steady_clock::now() - runStart).count();
+	processedFrames_s = pipelines[0]->getProcessedFrames();
+	for (auto pipeline : pipelines) 
+	{
+		pipeline->saveModel();
+		pipeline->printReport(staleness);
+		delete pipeline;
 	}
 
 	double allTime = double((clock() - tic)) / CLOCKS_PER_SEC;
 	double fps = double(processedFrames_s) / allTime;
 	printf("finished in %f seconds\n%f fps\n", allTime, fps);
-	delete[] trackInfo;
+	scheduler.printReport();
+
+	// ---------- latency of every stage, also saved next to the other logs ----------
+	string stageReport = StageProfiler::toString();
+	printf("%s", stageReport.c_str());
+	ofstream stageLog("StageLatency.txt");
+	stageLog << stageReport;
+	stageLog.close();
+
+	// ---------- throughput of the tracking loop (setup excluded) ----------
+	int fusedFrames = scheduler.getFusedCount();
+	double loopFps = (runTime > 0) ? fusedFrames / runTime : 0.0;
+	printf("throughput: %d frames x %d cameras in %.2f s = %.2f fps, %.1f camera-frames/s, %.2fx real time (%s)\n",
+		fusedFrames, CAMERAS_CNT, runTime, loopFps, loopFps * CAMERAS_CNT, loopFps / sourceFps, options.headless ? "headless" : "GUI");
+	fflush(stdout);
+
 	delete videoReader;
 	delete configurator;
 
-	system("PAUSE");
+	if (!options.headless) system("PAUSE");
 	return 0;
 }
 
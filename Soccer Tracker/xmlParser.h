@@ -21,7 +21,7 @@ class xmlParser {
 		xmlParser(void) {}
 
 		//=========================================================================================
-		static int parseBallPositions(string fileName, vector<pair<int, Point>>& outVctr) {
+		static int parseBallPositions(string fileName, vector<pair<int, Point>>& outVctr, bool mirrorX = false) {
 
 			outVctr.clear();
 
@@ -37,8 +37,8 @@ class xmlParser {
 			pugi::xml_node ballPos = ball.find_child_by_attribute("name", "BallPos");
 			pugi::xml_node ballShot = ball.find_child_by_attribute("name", "BallShot");
 
-			// CLEAN UP
-			if ((fileName.compare("ground_truth_ordered\\ground_truth_2.xgtf") == 0) || (fileName.compare("ground_truth_ordered\\ground_truth_4.xgtf") == 0) || (fileName.compare("ground_truth_ordered\\ground_truth_6.xgtf") == 0))
+			// CLEAN UP (positions of some cameras are stored mirrored)
+			if (mirrorX)
 			{
 				
 				for (pugi::xml_node point : ballPos.children()) {